@@ -0,0 +1,56 @@
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
+#include "Arena.h"
+
+void Arena::add_block(std::size_t min_size)
+{
+    const std::size_t size = std::max(BLOCK_SIZE, min_size + sizeof(Block) + alignof(std::max_align_t));
+    Block *block = static_cast<Block *>(::operator new(size));
+    block->previous = current;
+    block->size = size;
+    current = block;
+    cursor = reinterpret_cast<char *>(block + 1);
+    limit = reinterpret_cast<char *>(block) + size;
+}
+
+void *Arena::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    std::uintptr_t at = (reinterpret_cast<std::uintptr_t>(cursor) + alignment - 1) & ~(alignment - 1);
+    if (current == nullptr || at + bytes > reinterpret_cast<std::uintptr_t>(limit)) {
+        add_block(bytes + alignment);
+        at = (reinterpret_cast<std::uintptr_t>(cursor) + alignment - 1) & ~(alignment - 1);
+    }
+
+    char *result = reinterpret_cast<char *>(at);
+    allocated += result + bytes - cursor;
+    cursor = result + bytes;
+    last_allocation = result;
+    return result;
+}
+
+void Arena::do_deallocate(void *p, std::size_t bytes, std::size_t)
+{
+    // Only the latest allocation can be given back, e.g. a scratch buffer dropped before
+    // anything else was allocated. A growing vector frees its old buffer after allocating
+    // the new one, so that space stays taken until release()
+    if (p == last_allocation && static_cast<char *>(p) + bytes == cursor) {
+        allocated -= bytes;
+        cursor = static_cast<char *>(p);
+        last_allocation = nullptr;
+    }
+}
+
+void Arena::release()
+{
+    while (current != nullptr) {
+        Block *previous = current->previous;
+        ::operator delete(current);
+        current = previous;
+    }
+    cursor = nullptr;
+    limit = nullptr;
+    allocated = 0;
+    last_allocation = nullptr;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <memory_resource>
+#include <cstddef>
+
+// Bump allocator owned by a compilation session. Allocations are carved out of large blocks
+// and never freed one by one, release() drops all of them at once.
+// Not thread safe.
+class Arena : public std::pmr::memory_resource {
+    struct Block {
+        Block *previous;
+        std::size_t size;
+    };
+
+    Block *current = nullptr;
+    char *cursor = nullptr;
+    char *limit = nullptr;
+    std::size_t allocated = 0;
+
+    void *last_allocation = nullptr;
+
+    void add_block(std::size_t min_size);
+
+protected:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+public:
+    static constexpr std::size_t BLOCK_SIZE = 1024 * 1024;
+
+    Arena() = default;
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    ~Arena() override { release(); }
+
+    // Everything allocated from the arena is invalid afterwards
+    void release();
+
+    // Bytes handed out, alignment padding included
+    std::size_t get_allocated() const { return allocated; }
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <memory_resource>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+#include "BasicType.h"
+
+enum class UnaryOperator : uint8_t {
+    NONE,
+    PLUS,
+    MINUS,
+    NOT
+};
+
+enum class BinaryOperator : uint8_t {
+    ADD,
+    SUBTRACT,
+    MULTIPLY,
+    DIVIDE
+};
+
+// Index of a node in its Ast
+using NodeId = uint32_t;
+
+// Nodes refer to their children by index, never by pointer. What lhs, rhs and op hold depends on kind.
+// A list is an index into Ast::extra where the count is followed by the items
+struct AstNode {
+    enum class Kind : uint8_t {
+        PROGRAM, // lhs: list of global statements
+        STATIC_VAR_DEFINITION, // lhs: SymbolId, op: BasicType
+        PROCEDURE_DEFINITION, // lhs: SymbolId, op: return BasicType, rhs: extra index of the block, the list of parameters follows it
+        PARAMETER, // lhs: SymbolId, op: BasicType
+        BLOCK, // lhs: list of statements
+        EXPRESSION_STATEMENT, // lhs: expression
+        RETURN_STATEMENT, // lhs: expression
+        ASSIGNMENT, // lhs: IDENTIFIER assigned to, rhs: expression
+        UNARY_OPERATION, // op: UnaryOperator, lhs: operand
+        BINARY_OPERATION, // op: BinaryOperator, lhs, rhs: operands
+        PARENTHESIZED, // lhs: expression
+        CALL, // lhs: IDENTIFIER called, rhs: list of arguments
+        IDENTIFIER, // lhs: SymbolId
+        NUMERIC_LITERAL, // lhs: index into TokenStream::literals
+    };
+
+    Kind kind;
+    uint8_t op;
+    // Tokens [first_token, end_token) make up the node
+    uint32_t first_token;
+    uint32_t end_token;
+    uint32_t lhs;
+    uint32_t rhs;
+
+    uint32_t get_token_length() const { return end_token - first_token; }
+};
+
+static_assert(std::is_trivially_copyable_v<AstNode>);
+static_assert(sizeof(AstNode) == 20);
+
+// Flat tree of one compilation. Adding a node is a push_back, children are added before
+// their parents so the root comes last. The tree goes away with its memory resource in one go
+class Ast {
+    std::pmr::vector<AstNode> nodes;
+    std::pmr::vector<uint32_t> extra;
+
+public:
+    // memory is usually the session Arena, like the one of the tokens
+    explicit Ast(std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+        : nodes(memory), extra(memory) {}
+
+    NodeId add(const AstNode &node) {
+        nodes.push_back(node);
+        return static_cast<NodeId>(nodes.size() - 1);
+    }
+
+    // Appends count then items to extra, returns where the list starts
+    uint32_t add_list(std::span<const NodeId> items) {
+        const uint32_t index = static_cast<uint32_t>(extra.size());
+        extra.push_back(static_cast<uint32_t>(items.size()));
+        extra.insert(extra.end(), items.begin(), items.end());
+        return index;
+    }
+
+    uint32_t add_extra(const uint32_t value) {
+        extra.push_back(value);
+        return static_cast<uint32_t>(extra.size() - 1);
+    }
+
+    // Most nodes parsed from tokens_count tokens: every node but PROGRAM owns a token no other
+    // node owns, e.g. its operator, ';', '{' or name
+    static constexpr std::size_t estimate_nodes_count(const std::size_t tokens_count) { return tokens_count + 1; }
+
+    // Lists take about two thirds of a word per node, extra may still grow past that
+    void reserve(const std::size_t nodes_count) {
+        nodes.reserve(nodes_count);
+        extra.reserve(nodes_count * 2 / 3);
+    }
+
+    void clear() {
+        nodes.clear();
+        extra.clear();
+    }
+
+    // Size of the tree at some point, truncate() goes back to it
+    struct Mark {
+        std::size_t nodes_count;
+        std::size_t extra_count;
+    };
+
+    Mark mark() const { return Mark{nodes.size(), extra.size()}; }
+
+    // Drops the nodes and lists added since mark, e.g. the ones of a parse that failed
+    void truncate(const Mark mark) {
+        nodes.resize(mark.nodes_count);
+        extra.resize(mark.extra_count);
+    }
+
+    std::size_t size() const { return nodes.size(); }
+    bool empty() const { return nodes.empty(); }
+
+    const AstNode &operator[](const NodeId id) const { return nodes[id]; }
+
+    uint32_t get_extra(const uint32_t index) const { return extra[index]; }
+
+    std::span<const NodeId> get_list(const uint32_t index) const {
+        return std::span<const NodeId>(extra.data() + index + 1, extra[index]);
+    }
+
+    // Bytes held by the tree
+    std::size_t get_memory_size() const {
+        return nodes.capacity() * sizeof(AstNode) + extra.capacity() * sizeof(uint32_t);
+    }
+
+    // Shortcuts for the kinds that keep more than two fields
+
+    NodeId get_procedure_block(const NodeId procedure) const { return extra[nodes[procedure].rhs]; }
+    std::span<const NodeId> get_procedure_parameters(const NodeId procedure) const {
+        return get_list(nodes[procedure].rhs + 1);
+    }
+};
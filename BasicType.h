@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+// Ordered from the smallest, shared by the lexer and the parser
+enum class BasicType : uint8_t {
+    NIL,
+    U8,
+    U32,
+};
@@ -0,0 +1,87 @@
+#include <cstring>
+
+#include "ContentHash.h"
+
+namespace content_hash {
+
+namespace {
+
+constexpr uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t PRIME_3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t PRIME_4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t PRIME_5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotl(const uint64_t x, const int r) { return (x << r) | (x >> (64 - r)); }
+
+// Little endian hosts only, like the token files
+inline uint64_t read64(const char *p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t read32(const char *p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t round(uint64_t acc, const uint64_t input) {
+    acc += input * PRIME_2;
+    return rotl(acc, 31) * PRIME_1;
+}
+
+inline uint64_t merge_round(uint64_t acc, const uint64_t value) {
+    acc ^= round(0, value);
+    return acc * PRIME_1 + PRIME_4;
+}
+
+} // namespace
+
+uint64_t xxh64(std::string_view data, const uint64_t seed)
+{
+    const char *p = data.data();
+    const char *const end = p + data.size();
+    uint64_t h;
+
+    // Four independent lanes over 32 byte stripes
+    if (data.size() >= 32) {
+        uint64_t v1 = seed + PRIME_1 + PRIME_2;
+        uint64_t v2 = seed + PRIME_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME_1;
+        for (; end - p >= 32; p += 32) {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+        }
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge_round(h, v1);
+        h = merge_round(h, v2);
+        h = merge_round(h, v3);
+        h = merge_round(h, v4);
+    } else {
+        h = seed + PRIME_5;
+    }
+    h += data.size();
+
+    for (; end - p >= 8; p += 8)
+        h = rotl(h ^ round(0, read64(p)), 27) * PRIME_1 + PRIME_4;
+    if (end - p >= 4) {
+        h = rotl(h ^ (read32(p) * PRIME_1), 23) * PRIME_2 + PRIME_3;
+        p += 4;
+    }
+    for (; p < end; p++)
+        h = rotl(h ^ (static_cast<uint8_t>(*p) * PRIME_5), 11) * PRIME_1;
+
+    h ^= h >> 33;
+    h *= PRIME_2;
+    h ^= h >> 29;
+    h *= PRIME_3;
+    h ^= h >> 32;
+    return h;
+}
+
+} // namespace content_hash
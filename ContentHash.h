@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace content_hash {
+
+// XXH64 of data, bit compatible with the reference xxHash implementation
+uint64_t xxh64(std::string_view data, uint64_t seed = 0);
+
+} // namespace content_hash
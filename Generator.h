@@ -0,0 +1,87 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <optional>
+#include <utility>
+
+// Lazily evaluated sequence produced by a coroutine with co_yield, in the spirit of
+// C++23 std::generator. Nothing runs until the first value is requested.
+template <typename T>
+class Generator {
+public:
+    struct promise_type {
+        std::optional<T> current;
+
+        Generator get_return_object() { return Generator{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(T value) {
+            current = std::move(value);
+            return {};
+        }
+        void return_void() {}
+        void unhandled_exception() { throw; }
+    };
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit Generator(std::coroutine_handle<promise_type> h) : handle(h) {}
+
+public:
+    Generator(Generator &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Generator &operator=(Generator &&other) noexcept {
+        if (this != &other) {
+            if (handle)
+                handle.destroy();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    Generator(const Generator &) = delete;
+    Generator &operator=(const Generator &) = delete;
+
+    ~Generator() {
+        if (handle)
+            handle.destroy();
+    }
+
+    // Runs the coroutine up to its next value. Returns false once it has finished
+    bool next() {
+        if (!handle || handle.done())
+            return false;
+        handle.resume();
+        return !handle.done();
+    }
+
+    // The value of the last successful next()
+    const T &value() const { return handle.promise().current.value(); }
+
+    class iterator {
+        Generator *generator = nullptr;
+        bool is_done = true;
+
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+        explicit iterator(Generator *g) : generator(g), is_done(!g->next()) {}
+
+        const T &operator*() const { return generator->value(); }
+
+        iterator &operator++() {
+            is_done = !generator->next();
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+
+        bool operator==(std::default_sentinel_t) const { return is_done; }
+    };
+
+    iterator begin() { return iterator(this); }
+    std::default_sentinel_t end() { return std::default_sentinel; }
+};
@@ -0,0 +1,38 @@
+#include <cstring>
+#include <algorithm>
+
+#include "Interner.h"
+
+Interner::~Interner()
+{
+    for (const auto &[block, size] : blocks)
+        memory->deallocate(block, size, 1);
+}
+
+SymbolId Interner::intern(std::string_view name)
+{
+    auto found = ids.find(name);
+    if (found != ids.end())
+        return found->second;
+
+    std::string_view stored = store(name);
+    SymbolId id = static_cast<SymbolId>(names.size());
+    names.push_back(stored);
+    ids.emplace(stored, id);
+    return id;
+}
+
+std::string_view Interner::store(std::string_view name)
+{
+    // Names never move, the map and the ids point at them
+    if (block_used + name.length() > block_size) {
+        block_size = std::max(BLOCK_SIZE, name.length());
+        blocks.emplace_back(static_cast<char *>(memory->allocate(block_size, 1)), block_size);
+        block_used = 0;
+    }
+
+    char *destination = blocks.back().first + block_used;
+    std::memcpy(destination, name.data(), name.length());
+    block_used += name.length();
+    return std::string_view(destination, name.length());
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <memory_resource>
+#include <cstdint>
+
+using SymbolId = uint32_t;
+
+// Maps every distinct identifier of a compilation to a dense id, starting from 0.
+// Names are copied once into blocks taken from the interner's memory resource.
+class Interner {
+    std::pmr::unordered_map<std::string_view, SymbolId> ids;
+    std::pmr::vector<std::string_view> names;
+
+    std::pmr::memory_resource *memory;
+    std::pmr::vector<std::pair<char *, std::size_t>> blocks;
+    std::size_t block_used = 0;
+    std::size_t block_size = 0;
+
+    std::string_view store(std::string_view name);
+
+public:
+    static constexpr std::size_t BLOCK_SIZE = 64 * 1024;
+
+    explicit Interner(std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+        : ids(memory), names(memory), memory(memory), blocks(memory) {}
+    Interner(const Interner &) = delete;
+    Interner &operator=(const Interner &) = delete;
+    ~Interner();
+
+    SymbolId intern(std::string_view name);
+
+    std::string_view get_name(const SymbolId id) const { return names[id]; }
+
+    std::size_t size() const { return names.size(); }
+};
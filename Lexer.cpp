@@ -1,14 +1,28 @@
 #include "Lexer.h"
+#include "TokenFile.h"
+#include "LexerSimd.h"
+#include "Utf8.h"
 
-// Not all of them are here
-std::vector<std::pair<std::string, Token::Type>> Token::symbol_to_token_type_map = {
-    {"proc ", Token::Type::PROC},
-    {"staticvar ", Token::Type::STATICVAR},
+#include <array>
+#include <unordered_map>
+#include <thread>
+#include <string_view>
+
+namespace lexer_dfa {
+
+struct Symbol {
+    std::string_view text;
+    Token::Type type;
+};
+
+// Every punctuator. Reserved words are lexed as identifiers first, see reserved_words
+constexpr Symbol symbols[] = {
     {":=", Token::Type::ASSIGN},
     {":", Token::Type::COLON},
     {";", Token::Type::SEMICOLON},
-    {"return ", Token::Type::RETURN},
+    {",", Token::Type::COMMA},
     {"->", Token::Type::RIGHTARROW},
+    {"<-", Token::Type::LEFTARROW},
     {"(", Token::Type::LPAREN},
     {")", Token::Type::RPAREN},
     {"{", Token::Type::LCURLY},
@@ -18,115 +32,536 @@ std::vector<std::pair<std::string, Token::Type>> Token::symbol_to_token_type_map
     {"*", Token::Type::ASTERISK},
     {"/", Token::Type::SLASH},
     {"=", Token::Type::EQUAL},
+    {"~", Token::Type::TILDA},
 };
 
-std::vector<std::string> Token::basic_data_types = {
-    "u8",
-    "u32",
-    "nil",
+constexpr std::size_t MAX_STATES = 64;
+constexpr std::size_t MAX_CLASSES = 64;
+
+// Fixed states, trie states of the symbols follow them
+constexpr uint8_t REJECT = 0;
+constexpr uint8_t START = 1;
+constexpr uint8_t IDENTIFIER = 2;
+constexpr uint8_t NUMBER = 3;
+
+// Fixed byte classes, every byte used by a symbol gets a class of its own
+constexpr uint8_t CLASS_OTHER = 0;
+constexpr uint8_t CLASS_ALPHA = 1;
+constexpr uint8_t CLASS_DIGIT = 2;
+
+// Only a-z A-Z and _
+constexpr bool can_id_start_with(char ch)
+{
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+}
+
+constexpr bool is_digit(char ch)
+{
+    return ch >= '0' && ch <= '9';
+}
+
+struct Tables {
+    std::array<uint8_t, 256> char_class{};
+    std::array<std::array<uint8_t, MAX_CLASSES>, MAX_STATES> next{};
+    std::array<Token::Type, MAX_STATES> accepts{};
+
+    uint8_t class_count = 3;
+    uint8_t state_count = 4;
 };
 
-bool Lexer::starts_with_at_pos(const std::string &prefix)
+constexpr Tables build_tables()
 {
-    if (pos + prefix.length() > source_text.length())
-        return false;
+    Tables t{};
+
+    // 256-entry first-byte dispatch
+    for (int ch = 0; ch < 256; ch++) {
+        if (can_id_start_with(static_cast<char>(ch)))
+            t.char_class[ch] = CLASS_ALPHA;
+        else if (is_digit(static_cast<char>(ch)))
+            t.char_class[ch] = CLASS_DIGIT;
+    }
+    for (const Symbol &symbol : symbols) {
+        for (char ch : symbol.text) {
+            uint8_t &cls = t.char_class[static_cast<unsigned char>(ch)];
+            if (cls == CLASS_OTHER)
+                cls = t.class_count++;
+        }
+    }
+
+    // Trie of the symbols
+    for (const Symbol &symbol : symbols) {
+        uint8_t state = START;
+        for (char ch : symbol.text) {
+            uint8_t &target = t.next[state][t.char_class[static_cast<unsigned char>(ch)]];
+            if (target == REJECT)
+                target = t.state_count++;
+            state = target;
+        }
+        t.accepts[state] = symbol.type;
+    }
 
-    std::string rest = source_text.substr(pos);
+    // Identifiers and numbers
+    t.next[START][CLASS_ALPHA] = IDENTIFIER;
+    t.next[START][CLASS_DIGIT] = NUMBER;
+    t.next[IDENTIFIER][CLASS_ALPHA] = IDENTIFIER;
+    t.next[IDENTIFIER][CLASS_DIGIT] = IDENTIFIER;
+    t.next[NUMBER][CLASS_DIGIT] = NUMBER;
+    t.accepts[IDENTIFIER] = Token::Type::ID;
+    t.accepts[NUMBER] = Token::Type::NUMERIC_LITERAL;
 
-    return rest.starts_with(prefix);
+    return t;
 }
 
-std::optional<Token> Lexer::try_symbol_as_token(const std::string &symbol, const Token::Type of_type)
+constexpr Tables tables = build_tables();
+
+static_assert(tables.state_count <= MAX_STATES, "Token DFA has too many states");
+static_assert(tables.class_count <= MAX_CLASSES, "Token DFA has too many byte classes");
+
+constexpr bool symbols_are_punctuators()
 {
-    if (starts_with_at_pos(symbol))
-        return Token(of_type, symbol);
-    else
-        return std::optional<Token>();
+    for (const Symbol &symbol : symbols) {
+        for (char ch : symbol.text) {
+            if (can_id_start_with(ch) || is_digit(ch))
+                return false;
+        }
+    }
+    return true;
+}
+
+static_assert(symbols_are_punctuators(), "Letters and digits belong to identifiers and numbers");
+
+} // namespace lexer_dfa
+
+// Keywords and basic data types. An identifier is looked up once after it is scanned,
+// in a table indexed by a perfect hash that is searched for at compile time.
+namespace reserved_words {
+
+struct Word {
+    std::string_view text;
+    Token::Type type;
+};
+
+constexpr Word words[] = {
+    {"proc", Token::Type::PROC},
+    {"staticvar", Token::Type::STATICVAR},
+    {"return", Token::Type::RETURN},
+    {"u8", Token::Type::BASIC_TYPE},
+    {"u32", Token::Type::BASIC_TYPE},
+    {"nil", Token::Type::BASIC_TYPE},
+};
+
+constexpr std::size_t TABLE_SIZE = 16;
+static_assert(std::size(words) <= TABLE_SIZE);
+
+// Length, first and last byte tell the words apart, only the multipliers are searched for
+constexpr std::size_t hash(std::string_view word, const uint32_t first_mul, const uint32_t last_mul)
+{
+    return (word.length() + static_cast<unsigned char>(word.front()) * first_mul
+        + static_cast<unsigned char>(word.back()) * last_mul) % TABLE_SIZE;
+}
+
+struct Table {
+    uint32_t first_mul = 0;
+    uint32_t last_mul = 0;
+    std::array<Word, TABLE_SIZE> slots{};
+};
+
+constexpr Table build_table()
+{
+    for (uint32_t first_mul = 1; first_mul < 256; first_mul++) {
+        for (uint32_t last_mul = 0; last_mul < 256; last_mul++) {
+            Table table{first_mul, last_mul, {}};
+            bool collides = false;
+            for (const Word &word : words) {
+                Word &slot = table.slots[hash(word.text, first_mul, last_mul)];
+                collides = collides || !slot.text.empty();
+                slot = word;
+            }
+            if (!collides)
+                return table;
+        }
+    }
+    return Table{};
+}
+
+constexpr Table table = build_table();
+static_assert(table.first_mul != 0, "No perfect hash found for the reserved words");
+
+// ID if the identifier is not reserved
+constexpr Token::Type classify(std::string_view identifier)
+{
+    const Word &slot = table.slots[hash(identifier, table.first_mul, table.last_mul)];
+    return slot.text == identifier ? slot.type : Token::Type::ID;
 }
 
+static_assert(classify("proc") == Token::Type::PROC);
+static_assert(classify("u32") == Token::Type::BASIC_TYPE);
+static_assert(classify("procedure") == Token::Type::ID);
+
+} // namespace reserved_words
+
 Token Lexer::consume(Token token)
 {
-    pos += token.value.length();
+    pos += token.length;
     assert(pos <= source_text.length());
 
     return token;
 }
 
-std::optional<Token> Lexer::parse_token()
+std::size_t Lexer::skip_blanks(std::string_view text, std::size_t pos)
+{
+    return lexer_simd::skip_blanks(text.data(), pos, text.length());
+}
+
+std::size_t Lexer::skip_comment(std::string_view text, std::size_t pos)
+{
+    std::size_t line_end = lexer_simd::find_newline(text.data(), pos, text.length());
+    return line_end == text.length() ? std::string_view::npos : line_end + 1;
+}
+
+Token Lexer::scan_with_dfa(std::string_view text, std::size_t pos, bool *reached_end)
 {
-    // Skip spaces and newlines
-    while (source_text[pos] == ' ' || source_text[pos] == '\n' || source_text[pos] == '\0') {
-        if (pos + 1 >= source_text.length())
-            return std::optional<Token>();
-        pos += 1;
+    using namespace lexer_dfa;
+
+    std::string_view rest = text.substr(pos);
+
+    uint8_t state = START;
+    Token::Type matched_type = Token::Type::NONE;
+    std::size_t matched_len = 0;
+
+    // Maximal munch: walk until the DFA rejects, remember the last accepting state
+    std::size_t i = 0;
+    for (; i < rest.length(); i++) {
+        state = tables.next[state][tables.char_class[static_cast<unsigned char>(rest[i])]];
+        if (state == REJECT)
+            break;
+
+        if (tables.accepts[state] != Token::Type::NONE) {
+            matched_type = tables.accepts[state];
+            matched_len = i + 1;
+        }
     }
 
-    // Strip comments
-    if (source_text[pos] == '#') {
-        while (source_text[pos++] != '\n');
+    if (reached_end)
+        *reached_end = i == rest.length();
+
+    if (matched_type == Token::Type::ID)
+        matched_type = reserved_words::classify(rest.substr(0, matched_len));
+
+    return Token(matched_type, pos, matched_len);
+}
+
+Token Lexer::scan_unicode(std::string_view text, std::size_t pos, bool *reached_end)
+{
+    bool dfa_reached_end = false;
+    Token token = scan_with_dfa(text, pos, &dfa_reached_end);
+    const std::size_t end = pos + token.length;
+
+    // The DFA stops at the first non-ASCII byte, it may start an identifier or go on with one
+    const bool is_identifier = token.length > 0 && lexer_dfa::can_id_start_with(text[pos]);
+    if (end >= text.length() || static_cast<unsigned char>(text[end]) < 0x80 || (token.length > 0 && !is_identifier)) {
+        if (reached_end)
+            *reached_end = dfa_reached_end;
+        return token;
     }
 
-    // Handling simple ones
-    for (const auto &bind : Token::symbol_to_token_type_map) {
-        if (!starts_with_at_pos(bind.first))
+    std::size_t at = end;
+    bool cut_by_end = false;
+    while (at < text.length()) {
+        const unsigned char byte = static_cast<unsigned char>(text[at]);
+        if (byte < 0x80) {
+            if (!lexer_dfa::can_id_start_with(byte) && !lexer_dfa::is_digit(byte))
+                break;
+            at++;
             continue;
+        }
 
-        return consume(Token(bind.second, bind.first));
+        char32_t code_point;
+        const std::size_t length = utf8::decode(text, at, code_point);
+        if (length == 0) {
+            // A chunk of a stream may end inside a sequence
+            cut_by_end = utf8::sequence_length(byte) != 0 && at + utf8::sequence_length(byte) > text.length();
+            break;
+        }
+        if (!(at == pos ? utf8::is_xid_start(code_point) : utf8::is_xid_continue(code_point)))
+            break;
+        at += length;
     }
 
-    // Handling numerical tokens
-    unsigned int number_len = 0;
-    for (; pos + number_len < source_text.length(); number_len++) {
-        if (!std::isdigit(static_cast<unsigned char>(source_text[pos + number_len])))
+    if (reached_end)
+        *reached_end = cut_by_end || at == text.length();
+
+    if (at == pos)
+        return Token(Token::Type::NONE, pos, 0);
+    // Reserved words are ASCII, this is never one
+    return Token(Token::Type::ID, pos, at - pos);
+}
+
+void Lexer::validate_source()
+{
+    // Callers refuse longer sources, token offsets would wrap
+    assert(source_text.length() <= Token::MAX_SOURCE_SIZE);
+
+    const utf8::Validation validation = utf8::validate(source_text);
+    source_is_ascii = validation.ascii;
+    if (validation.valid)
+        invalid_utf8_offset.reset();
+    else
+        invalid_utf8_offset = validation.error_offset;
+}
+
+std::optional<Token> Lexer::parse_token()
+{
+    while (true) {
+        // Skip spaces and newlines
+        pos = skip_blanks(source_text, pos);
+        if (pos >= source_text.length())
+            break;
+
+        // Strip comments
+        if (source_text[pos] == '#') {
+            pos = skip_comment(source_text, pos);
+            if (pos == std::string_view::npos)
+                pos = source_text.length();
+            continue;
+        }
+
+        Token token = source_is_ascii ? scan_with_dfa(source_text, pos) : scan_unicode(source_text, pos);
+        if (token.type == Token::Type::NONE)
             break;
+
+        if (token.type == Token::Type::ID)
+            token.payload = interner.intern(get_token_value(token));
+
+        return consume(token);
     }
-    if (number_len > 0) {
-        return consume(Token(Token::Type::NUMERIC_LITERAL, source_text.substr(pos, number_len)));
+
+    return std::optional<Token>(); // return nothing
+}
+
+void Lexer::push_pooled_token(const Token::Type type, std::string_view value)
+{
+    tokens.push_back(Token(type, pooled_text.length(), value.length()));
+    pooled_text += value;
+    source_text = pooled_text;
+    fill_payloads(tokens.size() - 1);
+}
+
+const TokenStream &Lexer::relex(std::string_view new_source, const Edit &edit)
+{
+    const int64_t shift = static_cast<int64_t>(edit.inserted_length) - edit.removed_length;
+    const std::size_t new_edit_end = static_cast<std::size_t>(edit.offset) + edit.inserted_length;
+
+    // First token that ends at or after the edit, a token ending right at it may grow.
+    // Nothing but blanks and comments lies between the token before it and the edit
+    std::size_t first = 0;
+    std::size_t count = tokens.size();
+    while (count > 0) {
+        std::size_t half = count / 2;
+        if (tokens.offset_at(first + half) + tokens.length_at(first + half) < edit.offset) {
+            first += half + 1;
+            count -= half + 1;
+        } else {
+            count = half;
+        }
     }
+    std::size_t at = first == 0 ? 0 : tokens.offset_at(first - 1) + tokens.length_at(first - 1);
 
-    // Handling identifiers
-    if (can_id_start_with(source_text[pos])) {
-        unsigned int identifier_len = 1;
-        for (; pos + identifier_len < source_text.length(); identifier_len++) {
-            if (!can_id_start_with(source_text[pos + identifier_len]) 
-                && !std::isdigit(static_cast<unsigned char>(source_text[pos + identifier_len]))) {
-                break;
-                }
+    source_text = new_source;
+    line_index.reset();
+    validate_source();
+
+    TokenStream relexed{};
+    std::size_t old_index = first;
+    std::optional<std::size_t> resync_index;
+    while (true) {
+        at = skip_blanks(source_text, at);
+        if (at >= source_text.length())
+            break;
+
+        if (source_text[at] == '#') {
+            at = skip_comment(source_text, at);
+            if (at == std::string_view::npos)
+                at = source_text.length();
+            continue;
         }
-        std::string id_symbol = source_text.substr(pos, identifier_len);
-        
-        //using data_types = Token::basic_data_types;
-        if (std::find(Token::basic_data_types.begin(), Token::basic_data_types.end(), id_symbol) != Token::basic_data_types.end()) {
-            // Treat as basic data type
-            return consume(Token(Token::Type::BASIC_TYPE, id_symbol));
+
+        // Past the edit the bytes are the old ones shifted, a token starting where an old
+        // one started is lexed from the same state, so is everything after it
+        if (at >= new_edit_end) {
+            const int64_t old_at = static_cast<int64_t>(at) - shift;
+            while (old_index < tokens.size() && tokens.offset_at(old_index) < old_at)
+                old_index += 1;
+            if (old_index < tokens.size() && tokens.offset_at(old_index) == old_at) {
+                resync_index = old_index;
+                break;
+            }
         }
 
-        return consume(Token(Token::Type::ID, id_symbol));
+        Token token = source_is_ascii ? scan_with_dfa(source_text, at) : scan_unicode(source_text, at);
+        if (token.type == Token::Type::NONE)
+            break;
+
+        // Literals go with the replacement so splice keeps them in token order
+        if (token.type == Token::Type::ID)
+            token.payload = interner.intern(get_token_value(token));
+        else if (token.type == Token::Type::NUMERIC_LITERAL)
+            token.payload = relexed.add_literal(NumericLiteral::decode(get_token_value(token)));
+
+        relexed.push_back(token);
+        at += token.length;
     }
 
-    return std::optional<Token>(); // return nothing
+    if (resync_index.has_value()) {
+        pos = static_cast<std::size_t>(static_cast<int64_t>(pos) + shift);
+        tokens.splice(first, resync_index.value(), relexed, shift);
+    } else {
+        pos = at;
+        tokens.splice(first, tokens.size(), relexed, 0);
+    }
+
+    return tokens;
+}
+
+SourceLocation Lexer::get_location(const uint32_t offset) const
+{
+    if (!line_index)
+        line_index = std::make_unique<LineIndex>(source_text);
+
+    return line_index->locate(offset);
+}
+
+void Lexer::store_token(Token token)
+{
+    if (token.type == Token::Type::NUMERIC_LITERAL)
+        token.payload = tokens.add_literal(NumericLiteral::decode(get_token_value(token)));
+
+    tokens.push_back(token);
 }
 
-std::vector<Token> Lexer::tokenize()
+const TokenStream &Lexer::tokenize()
 {
+    tokens.reserve(tokens.size() + estimate_tokens_count(source_text.length() - pos));
     while (true) {
         std::optional<Token> token = parse_token();
         if (!token.has_value())
             break;
 
-        tokens.push_back(token.value());
+        store_token(token.value());
+    }
+    return tokens;
+}
+
+Generator<Token> Lexer::tokenize_lazily()
+{
+    tokens.reserve(tokens.size() + estimate_tokens_count(source_text.length() - pos));
+    while (true) {
+        std::optional<Token> token = parse_token();
+        if (!token.has_value())
+            break;
+
+        store_token(token.value());
+        co_yield tokens[tokens.size() - 1];
+    }
+}
+
+std::size_t Lexer::tokenize_range(std::string_view text, std::size_t begin, const bool ascii_only, TokenStream &out)
+{
+    std::size_t at = begin;
+    while (true) {
+        at = skip_blanks(text, at);
+        if (at >= text.length())
+            return text.length();
+
+        if (text[at] == '#') {
+            at = skip_comment(text, at);
+            if (at == std::string_view::npos)
+                return text.length();
+            continue;
+        }
+
+        Token token = ascii_only ? scan_with_dfa(text, at) : scan_unicode(text, at);
+        if (token.type == Token::Type::NONE)
+            return at;
+
+        out.push_back(token);
+        at += token.length;
+    }
+}
+
+const TokenStream &Lexer::tokenize_parallel(const unsigned int threads_num)
+{
+    // One thread per chunk, never more than the cores
+    const unsigned int chunks_wanted = std::min(threads_num, std::max(1u, std::thread::hardware_concurrency()));
+    if (chunks_wanted <= 1 || source_text.length() - pos < PARALLEL_MIN_SIZE)
+        return tokenize();
+
+    // Chunk borders are moved forward to the next line start
+    std::vector<std::size_t> borders{pos};
+    const std::size_t chunk_size = (source_text.length() - pos) / chunks_wanted;
+    for (unsigned int i = 1; i < chunks_wanted; i++) {
+        std::size_t line_end = source_text.find('\n', std::max(pos + i * chunk_size, borders.back()));
+        if (line_end == std::string_view::npos)
+            break;
+        borders.push_back(line_end + 1);
+    }
+    borders.push_back(source_text.length());
+
+    const std::size_t chunks_num = borders.size() - 1;
+    std::vector<TokenStream> chunk_tokens(chunks_num);
+    std::vector<std::size_t> chunk_stops(chunks_num);
+
+    std::vector<std::thread> workers{};
+    for (std::size_t i = 0; i < chunks_num; i++) {
+        workers.emplace_back([&, i] {
+            // Offsets stay global, the view only ends where the chunk does
+            std::string_view chunk_text = source_text.substr(0, borders[i + 1]);
+            chunk_tokens[i].reserve(estimate_tokens_count(borders[i + 1] - borders[i]));
+            chunk_stops[i] = tokenize_range(chunk_text, borders[i], source_is_ascii, chunk_tokens[i]);
+        });
     }
+    for (std::thread &worker : workers)
+        worker.join();
+
+    const std::size_t first_merged = tokens.size();
+    std::size_t merged_size = tokens.size();
+    for (const TokenStream &chunk : chunk_tokens)
+        merged_size += chunk.size();
+    tokens.reserve(merged_size);
+
+    // The serial lexer stops at the first unknown symbol, so does the merge
+    for (std::size_t i = 0; i < chunks_num; i++) {
+        tokens.append(chunk_tokens[i]);
+        pos = chunk_stops[i];
+        if (chunk_stops[i] != borders[i + 1])
+            break;
+    }
+
+    // Payloads stay serial, symbol ids come out in source order like with tokenize()
+    fill_payloads(first_merged);
+
     return tokens;
 }
 
+void Lexer::fill_payloads(const std::size_t from, const std::size_t to)
+{
+    for (std::size_t i = from; i < std::min(to, tokens.size()); i++) {
+        if (tokens.type_at(i) == Token::Type::ID)
+            tokens.set_payload(i, interner.intern(get_token_value(tokens[i])));
+        else if (tokens.type_at(i) == Token::Type::NUMERIC_LITERAL)
+            tokens.set_payload(i, tokens.add_literal(NumericLiteral::decode(get_token_value(tokens[i]))));
+    }
+}
+
 nlohmann::json Lexer::serialize_to_json()
 {
     nlohmann::json json_array = nlohmann::json::array();
-    for (const auto &token : tokens) {
+    for (std::size_t i = 0; i < tokens.size(); i++) {
+        const Token token = tokens[i];
 
         nlohmann::json json_object = {
             {"type", magic_enum::enum_name(token.type)},
-            {"value", token.value}
+            {"value", get_token_value(token)}
         };
 
         // Add the JSON object to the JSON array
@@ -135,33 +570,220 @@ nlohmann::json Lexer::serialize_to_json()
     return json_array;
 }
 
-std::vector<Token> Lexer::load_from_json_str(std::string source)
+namespace {
+
+// Type names are hashed once, instead of a magic_enum string lookup per token
+std::optional<Token::Type> token_type_from_name(std::string_view name)
 {
-    // Flush the current tokens
+    static const std::unordered_map<std::string_view, Token::Type> types_by_name = [] {
+        std::unordered_map<std::string_view, Token::Type> map{};
+        for (const auto &[type, type_name] : magic_enum::enum_entries<Token::Type>())
+            map.emplace(type_name, type);
+        return map;
+    }();
+
+    auto found = types_by_name.find(name);
+    if (found == types_by_name.end())
+        return std::optional<Token::Type>();
+    return found->second;
+}
+
+// Streams [{"type": ..., "value": ...}, ...] straight into the token stream, no DOM is built
+class TokenJsonSax {
+    TokenStream &tokens;
+    std::string &pool;
+
+    enum class Key { OTHER, TYPE, VALUE };
+
+    int depth = 0;
+    Key current_key = Key::OTHER;
+    std::optional<Token::Type> current_type;
+    std::optional<Token> current_token;
+
+public:
+    std::string error;
+
+    TokenJsonSax(TokenStream &t, std::string &p) : tokens(t), pool(p) {}
+
+    bool start_array(std::size_t) {
+        if (depth != 0)
+            return fail("Could not parse the tokens, unexpected nested array.");
+        depth += 1;
+        return true;
+    }
+
+    bool end_array() {
+        depth -= 1;
+        return true;
+    }
+
+    bool start_object(std::size_t) {
+        if (depth != 1)
+            return fail("Could not parse the tokens, expected an array of token objects.");
+        depth += 1;
+        current_type.reset();
+        current_token.reset();
+        return true;
+    }
+
+    bool key(std::string &k) {
+        current_key = k == "type" ? Key::TYPE : (k == "value" ? Key::VALUE : Key::OTHER);
+        return true;
+    }
+
+    bool end_object() {
+        depth -= 1;
+        if (!current_type.has_value() || !current_token.has_value())
+            return fail("Could not parse the tokens, a token misses its type or value.");
+
+        current_token->type = current_type.value();
+        tokens.push_back(current_token.value());
+        return true;
+    }
+
+    bool string(std::string &val) {
+        if (depth != 2)
+            return fail("Could not parse the tokens, json structure is not correct.");
+
+        if (current_key == Key::TYPE) {
+            current_type = token_type_from_name(val);
+            if (!current_type.has_value())
+                return fail("Could not parse the token <<\"" + val + "\">>.\nThere is no such token type.");
+        } else if (current_key == Key::VALUE) {
+            current_token = Token(Token::Type::NONE, pool.length(), val.length());
+            pool += val;
+        }
+        return true;
+    }
+
+    bool null() { return scalar(); }
+    bool boolean(bool) { return scalar(); }
+    bool number_integer(nlohmann::json::number_integer_t) { return scalar(); }
+    bool number_unsigned(nlohmann::json::number_unsigned_t) { return scalar(); }
+    bool number_float(nlohmann::json::number_float_t, const std::string &) { return scalar(); }
+    bool binary(nlohmann::json::binary_t &) { return scalar(); }
+
+    bool parse_error(std::size_t, const std::string &, const nlohmann::json::exception &) {
+        return fail("Could not parse the tokens, json structure is not correct.");
+    }
+
+private:
+    // Only other keys of a token object may hold non-string values
+    bool scalar() {
+        if (depth != 2 || current_key != Key::OTHER)
+            return fail("Could not parse the tokens, json structure is not correct.");
+        return true;
+    }
+
+    bool fail(std::string message) {
+        if (error.empty())
+            error = std::move(message);
+        return false;
+    }
+};
+
+} // namespace
+
+const TokenStream &Lexer::load_from_json_str(std::string_view source)
+{
+    // Flush the current tokens, their values are pooled into pooled_text
     tokens.clear();
+    pooled_text.clear();
 
-    nlohmann::json json_array = nlohmann::json::parse(source, nullptr, false);
-    if (json_array.is_discarded()) {
-        std::cerr << "Could not parse the tokens, json structure is not correct.";
+    TokenJsonSax sax{tokens, pooled_text};
+    if (!nlohmann::json::sax_parse(source, &sax)) {
+        std::cerr << sax.error;
         exit(EXIT_FAILURE);
     }
-    for (const auto &json_item : json_array) {
-        assert(json_item.contains("type") && json_item.contains("value"));
 
-        Token parsed_token{};
-        std::optional<Token::Type> type = magic_enum::enum_cast<Token::Type>(json_item["type"].get<std::string>());
-        std::string value = json_item["value"].get<std::string>();
+    source_text = pooled_text;
+    fill_payloads(0);
+    return tokens;
+}
+
+void Lexer::serialize_to_binary(std::ostream &out) const
+{
+    const std::size_t count = tokens.size();
 
-        if (!type.has_value()) {
-            std::cerr << "Could not parse the token <<" << json_item["type"] << ">>."
-                << std::endl << "There is no such token type.";
+    // Values are packed back to back, offsets are rebased onto the pool
+    std::vector<uint32_t> pool_offsets(count);
+    uint64_t pool_size = 0;
+    for (std::size_t i = 0; i < count; i++) {
+        // Offsets are 32 bits wide in the file
+        if (pool_size > UINT32_MAX) {
+            std::cerr << "Could not write the tokens, their values take more than 4 GiB.";
             exit(EXIT_FAILURE);
         }
+        pool_offsets[i] = static_cast<uint32_t>(pool_size);
+        pool_size += tokens.length_at(i);
+    }
 
-        parsed_token.type = type.value();
-        parsed_token.value = value;
+    token_file::Header header{};
+    std::memcpy(header.magic, token_file::MAGIC, sizeof(header.magic));
+    header.version = token_file::VERSION;
+    header.token_count = count;
+    header.pool_size = pool_size;
 
-        tokens.push_back(parsed_token);
+    const token_file::Layout layout = token_file::Layout::of(count, pool_size).value();
+    const char padding[4] = {};
+
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(tokens.type_data()), count);
+    out.write(padding, layout.offsets - layout.types - count);
+    out.write(reinterpret_cast<const char *>(pool_offsets.data()), count * sizeof(uint32_t));
+    out.write(reinterpret_cast<const char *>(tokens.length_data()), count * sizeof(uint32_t));
+    for (std::size_t i = 0; i < count; i++) {
+        out.write(source_text.data() + tokens.offset_at(i), tokens.length_at(i));
     }
+}
+
+std::optional<std::string> Lexer::find_binary_error(std::string_view data)
+{
+    token_file::Header header{};
+    if (!token_file::has_magic(data) || data.size() < sizeof(header))
+        return "Could not parse the tokens, not a binary token file.";
+    std::memcpy(&header, data.data(), sizeof(header));
+
+    if (header.version != token_file::VERSION)
+        return "Could not parse the tokens, unsupported token file version " + std::to_string(header.version) + ".";
+
+    std::optional<token_file::Layout> layout_of_header = token_file::counts_fit(header, data)
+        ? token_file::Layout::of(header.token_count, header.pool_size) : std::nullopt;
+    if (!layout_of_header.has_value() || layout_of_header.value().total > data.size())
+        return "Could not parse the tokens, token file is truncated.";
+    const token_file::Layout layout = layout_of_header.value();
+
+    // Sections need no alignment, words are copied out
+    for (std::size_t i = 0; i < header.token_count; i++) {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+        std::memcpy(&offset, data.data() + layout.offsets + i * sizeof(uint32_t), sizeof(offset));
+        std::memcpy(&length, data.data() + layout.lengths + i * sizeof(uint32_t), sizeof(length));
+        if (!magic_enum::enum_contains<Token::Type>(static_cast<Token::Type>(data[layout.types + i]))
+            || static_cast<uint64_t>(offset) + length > header.pool_size)
+            return "Could not parse the token #" + std::to_string(i) + ", token file is corrupted.";
+    }
+    return std::nullopt;
+}
+
+const TokenStream &Lexer::load_from_binary(std::string_view data)
+{
+    tokens.clear();
+    pooled_text.clear();
+
+    if (std::optional<std::string> error = find_binary_error(data)) {
+        std::cerr << error.value();
+        exit(EXIT_FAILURE);
+    }
+
+    token_file::Header header{};
+    std::memcpy(&header, data.data(), sizeof(header));
+    const token_file::Layout layout = token_file::Layout::of(header.token_count, header.pool_size).value();
+
+    tokens.assign(data.data() + layout.types, data.data() + layout.offsets, data.data() + layout.lengths,
+        header.token_count);
+
+    source_text = data.substr(layout.pool, header.pool_size);
+    fill_payloads(0);
     return tokens;
 }
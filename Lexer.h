@@ -1,8 +1,10 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <optional>
+#include <memory>
 #include <map>
 #include <cctype>  // For std::isdigit
 #include <cassert>
@@ -12,71 +14,138 @@
 #include "nlohmann/json.hpp"
 #include "magic_enum.hpp"
 
-struct Token {
-    enum class Type {
-        NONE,
-        ID,
-        PROC,
-        LPAREN,
-        RPAREN,
-        SEMICOLON,
-        COMMA,
-        COLON,
-        LEFTARROW, // <-
-        RIGHTARROW, // ->
-        BASIC_TYPE, // u8, u32, nil
-        LCURLY,
-        RCURLY,
-        RETURN,
-        ASTERISK,
-        SLASH, // /
-        PLUS,
-        MINUS,
-        STATICVAR,
-        ASSIGN, // :=
-        EQUAL, // =
-        TILDA,
-        NUMERIC_LITERAL,
-    };
+#include "Token.h"
+#include "Interner.h"
+#include "LineIndex.h"
+#include "Generator.h"
+
+class Lexer {
+    std::size_t pos = 0;
+    // Not owned, usually a mapped SourceFile. Points into pooled_text after loading tokens
+    std::string_view source_text;
+    std::string pooled_text;
 
-    static std::vector<std::pair<std::string, Token::Type>> symbol_to_token_type_map;
-    static std::vector<std::string> basic_data_types;
+    // Built on the first location lookup only
+    mutable std::unique_ptr<LineIndex> line_index;
 
-    Type type;
-    std::string value;
+    // Identifiers are interned as they are lexed, literals are decoded into tokens.literals
+    Interner &interner;
 
-    Token(const Type t=Type::NONE, const std::string &val="") : type(t), value(val) {}
-};
+    // The source is validated as UTF-8 up front. All-ASCII sources never leave the DFA,
+    // the others go through scan_unicode() for non-ASCII identifiers
+    bool source_is_ascii = true;
+    std::optional<std::size_t> invalid_utf8_offset;
 
-// #define TRY_SYMBOL_AS_TOKEN
+    void validate_source();
 
-class Lexer {
-    int pos = 0;
-    std::string source_text;
+    // Lexes [begin, text.length()) into out. Returns where it stopped, text.length()
+    // unless it met an unknown symbol
+    static std::size_t tokenize_range(std::string_view text, std::size_t begin, const bool ascii_only,
+                                      TokenStream &out);
 
-    bool starts_with_at_pos(const std::string &prefix);
+    // Decodes a NUMERIC_LITERAL into tokens.literals and appends the token
+    void store_token(Token token);
 
-    std::optional<Token> try_symbol_as_token(const std::string &symbol, const Token::Type of_type);
+    // Interns ID tokens and decodes NUMERIC_LITERAL ones in [from, to)
+    void fill_payloads(const std::size_t from, const std::size_t to = SIZE_MAX);
 
     // shifts pos
     Token consume(Token token);
 
-    // Only a-z A-Z and _
-    bool can_id_start_with(char ch) {
-        return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
-    }
-
 public:
-    std::vector<Token> tokens;
+    // Building blocks of every lexing mode, they only look at the given text
+
+    // Position of the first non-blank byte at or after pos, text.length() if there is none
+    static std::size_t skip_blanks(std::string_view text, std::size_t pos);
+
+    // Position right after the newline that ends the comment at pos, npos if the text ends first
+    static std::size_t skip_comment(std::string_view text, std::size_t pos);
+
+    // Runs the token DFA from pos and returns the longest match, NONE typed if nothing matched.
+    // reached_end tells whether the DFA ran out of text, a longer token could follow then
+    static Token scan_with_dfa(std::string_view text, std::size_t pos, bool *reached_end = nullptr);
+
+    // scan_with_dfa() for text that may not be ASCII: identifiers go on through, or start with,
+    // XID code points. Ill-formed UTF-8 is an unknown symbol
+    static Token scan_unicode(std::string_view text, std::size_t pos, bool *reached_end = nullptr);
+
+    TokenStream tokens;
+
+    // The source has to outlive the lexer and its tokens. Tokens are allocated from memory
+    Lexer(Interner &symbols, std::string_view t = "",
+          std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+        : source_text(t), interner(symbols), tokens(memory) { validate_source(); }
+
+    // Upper estimate of the tokens in bytes of source, to size the token stream once
+    static constexpr std::size_t estimate_tokens_count(const std::size_t bytes) { return bytes / 3 + 16; }
+
+    // Buffer every token of this lexer points into
+    std::string_view get_source_text() const { return source_text; }
+
+    std::string_view get_token_value(const Token &token) const { return token.value_in(source_text); }
 
-    Lexer(const std::string &t = "") : source_text(t) {}
+    // Where lexing stopped, the source length unless an unknown symbol was met
+    std::size_t get_pos() const { return pos; }
+
+    // Offset of the first byte of the source that is not well-formed UTF-8, no value if it is valid
+    std::optional<std::size_t> get_invalid_utf8_offset() const { return invalid_utf8_offset; }
+
+    // Line and column of a byte offset of the source. Only meaningful for tokens lexed
+    // from a source, not for loaded ones
+    SourceLocation get_location(const uint32_t offset) const;
+
+    // Appends a token together with a copy of its value, for tokens without a source buffer
+    void push_pooled_token(const Token::Type type, std::string_view value);
 
     // Non-pure, shifts pos. Returns no value if end of source_text
     std::optional<Token> parse_token();
 
-    std::vector<Token> tokenize();
+    const TokenStream &tokenize();
+
+    // tokenize() one token at a time: every resume lexes a token, appends it to tokens
+    // and yields it. Lets the parser run while the source is still being lexed
+    Generator<Token> tokenize_lazily();
+
+    // Bytes [offset, offset + removed_length) of the source were replaced by inserted_length bytes
+    struct Edit {
+        uint32_t offset;
+        uint32_t removed_length;
+        uint32_t inserted_length;
+    };
+
+    // Brings tokens up to date with new_source after an edit of the old one. Lexing starts
+    // at the end of the last token before the edit and stops as soon as a token starts
+    // where an old one did, the old tokens from there on are kept with shifted offsets.
+    const TokenStream &relex(std::string_view new_source, const Edit &edit);
+
+    // Bump whenever the tokens lexed from a source change, cached tokens of older versions are ignored
+    static constexpr uint32_t VERSION = 2;
+
+    // Below this size threads cost more than they save
+    static constexpr std::size_t PARALLEL_MIN_SIZE = 1024 * 1024;
+
+    // Same result as tokenize(). Lexes chunks split at newlines on threads_num threads, at most
+    // one per core. No token or comment goes over a newline so every chunk starts in a clean state
+    const TokenStream &tokenize_parallel(const unsigned int threads_num);
+
+    // Hands every token to sink.push(token, value) as soon as it is lexed, nothing is stored
+    template <typename Sink>
+    void tokenize_into(Sink &sink) {
+        while (std::optional<Token> token = parse_token())
+            sink.push(token.value(), get_token_value(token.value()));
+    }
 
     nlohmann::json serialize_to_json();
 
-    std::vector<Token> load_from_json_str(std::string source);
+    const TokenStream &load_from_json_str(std::string_view source);
+
+    // See TokenFile.h for the format
+    void serialize_to_binary(std::ostream &out) const;
+
+    // Token values are not copied, data has to outlive the lexer
+    const TokenStream &load_from_binary(std::string_view data);
+
+    // Why load_from_binary() would refuse data, no value if it is a sound token file.
+    // Looks at every token, for files that may be corrupted like cache entries
+    static std::optional<std::string> find_binary_error(std::string_view data);
 };
\ No newline at end of file
@@ -0,0 +1,89 @@
+// Lexing benchmark, run by make bench. Lexes sources of 1 KB up to 100 MB made by repeating
+// a sample file and fails if the time does not grow linearly with the size: the time per byte
+// of every size has to stay within MAX_SLOWDOWN of the fastest one.
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <optional>
+#include <algorithm>
+
+#include "Lexer.h"
+#include "SourceFile.h"
+
+namespace {
+
+constexpr double MAX_SLOWDOWN = 3.0;
+
+// Every size is lexed again until it took this long, small sources are timed over many runs
+constexpr double MIN_SECONDS = 0.2;
+
+// Whole lines of sample, repeated up to size bytes
+std::string make_source(std::string_view sample, const std::size_t size)
+{
+    std::string source{};
+    source.reserve(size + sample.length());
+    while (source.length() < size) {
+        source += sample;
+        if (source.back() != '\n')
+            source += '\n';
+    }
+    const std::size_t line_end = source.rfind('\n', size - 1);
+    source.resize(line_end == std::string::npos ? size : line_end + 1);
+    return source;
+}
+
+// Seconds per run of tokenize() over source
+double time_lexing(std::string_view source, std::size_t &tokens_count)
+{
+    std::size_t runs = 0;
+    std::chrono::duration<double> elapsed{0};
+    while (elapsed.count() < MIN_SECONDS) {
+        const auto start = std::chrono::steady_clock::now();
+        Interner interner{};
+        Lexer lexer{interner, source};
+        lexer.tokenize();
+        tokens_count = lexer.tokens.size();
+        elapsed += std::chrono::steady_clock::now() - start;
+        runs++;
+    }
+    return elapsed.count() / runs;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        std::cerr << "Usage: lexerbench <sample_source_file>" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::optional<SourceFile> sample = SourceFile::open(argv[1]);
+    if (!sample.has_value() || sample.value().get_text().empty()) {
+        std::cerr << "Can not read " << argv[1] << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::vector<double> nanoseconds_per_byte{};
+    for (std::size_t size = 1024; size <= 100 * 1024 * 1024; size *= 10) {
+        const std::string source = make_source(sample.value().get_text(), size);
+        std::size_t tokens_count = 0;
+        const double seconds = time_lexing(source, tokens_count);
+        nanoseconds_per_byte.push_back(seconds * 1e9 / source.length());
+
+        std::cout << std::setw(10) << source.length() << " bytes " << std::setw(9) << tokens_count << " tokens "
+            << std::fixed << std::setprecision(3) << std::setw(10) << seconds * 1000 << " ms "
+            << std::setw(7) << nanoseconds_per_byte.back() << " ns/byte" << std::endl;
+    }
+
+    const auto [fastest, slowest] = std::minmax_element(nanoseconds_per_byte.begin(), nanoseconds_per_byte.end());
+    if (*slowest > *fastest * MAX_SLOWDOWN) {
+        std::cerr << "Lexing is not linear: " << *slowest << " ns/byte against " << *fastest << " ns/byte" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include "LexerSimd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LEXER_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace lexer_simd {
+
+namespace {
+
+std::size_t skip_blanks_scalar(const char *data, std::size_t pos, const std::size_t len)
+{
+    while (pos < len && is_blank(data[pos]))
+        pos += 1;
+    return pos;
+}
+
+std::size_t find_newline_scalar(const char *data, std::size_t pos, const std::size_t len)
+{
+    while (pos < len && data[pos] != '\n')
+        pos += 1;
+    return pos;
+}
+
+#ifdef LEXER_SIMD_X86
+
+// SSE2 is only the baseline on x86_64, i386 builds need the target attribute like the AVX2 variants
+
+// Mask of the blank bytes in a block, one bit per byte
+__attribute__((target("sse2")))
+inline int blank_mask_sse2(const __m128i block)
+{
+    __m128i blanks = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\n'))),
+        _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\t')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\r'))));
+    blanks = _mm_or_si128(blanks, _mm_cmpeq_epi8(block, _mm_setzero_si128()));
+    return _mm_movemask_epi8(blanks);
+}
+
+__attribute__((target("sse2")))
+std::size_t skip_blanks_sse2(const char *data, std::size_t pos, const std::size_t len)
+{
+    // Most tokens are one blank apart, the scalar check is cheaper for them
+    if (pos < len && !is_blank(data[pos]))
+        return pos;
+
+    for (; pos + 16 <= len; pos += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+        unsigned int non_blank = ~static_cast<unsigned int>(blank_mask_sse2(block)) & 0xffffu;
+        if (non_blank != 0)
+            return pos + __builtin_ctz(non_blank);
+    }
+    return skip_blanks_scalar(data, pos, len);
+}
+
+__attribute__((target("sse2")))
+std::size_t find_newline_sse2(const char *data, std::size_t pos, const std::size_t len)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; pos + 16 <= len; pos += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+        unsigned int found = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+        if (found != 0)
+            return pos + __builtin_ctz(found);
+    }
+    return find_newline_scalar(data, pos, len);
+}
+
+__attribute__((target("avx2")))
+std::size_t skip_blanks_avx2(const char *data, std::size_t pos, const std::size_t len)
+{
+    if (pos < len && !is_blank(data[pos]))
+        return pos;
+
+    for (; pos + 32 <= len; pos += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos));
+        __m256i blanks = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\t')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\r'))));
+        blanks = _mm256_or_si256(blanks, _mm256_cmpeq_epi8(block, _mm256_setzero_si256()));
+
+        unsigned int non_blank = ~static_cast<unsigned int>(_mm256_movemask_epi8(blanks));
+        if (non_blank != 0)
+            return pos + __builtin_ctz(non_blank);
+    }
+    return skip_blanks_sse2(data, pos, len);
+}
+
+__attribute__((target("avx2")))
+std::size_t find_newline_avx2(const char *data, std::size_t pos, const std::size_t len)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+    for (; pos + 32 <= len; pos += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos));
+        unsigned int found = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline)));
+        if (found != 0)
+            return pos + __builtin_ctz(found);
+    }
+    return find_newline_sse2(data, pos, len);
+}
+
+#endif // LEXER_SIMD_X86
+
+using ScanFunction = std::size_t (*)(const char *, std::size_t, const std::size_t);
+
+struct Dispatch {
+    ScanFunction skip_blanks = skip_blanks_scalar;
+    ScanFunction find_newline = find_newline_scalar;
+
+    Dispatch() {
+#ifdef LEXER_SIMD_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            skip_blanks = skip_blanks_avx2;
+            find_newline = find_newline_avx2;
+        } else if (__builtin_cpu_supports("sse2")) {
+            skip_blanks = skip_blanks_sse2;
+            find_newline = find_newline_sse2;
+        }
+#endif
+    }
+};
+
+const Dispatch &dispatch()
+{
+    static const Dispatch selected{};
+    return selected;
+}
+
+} // namespace
+
+std::size_t skip_blanks(const char *data, std::size_t pos, const std::size_t len)
+{
+    return dispatch().skip_blanks(data, pos, len);
+}
+
+std::size_t find_newline(const char *data, std::size_t pos, const std::size_t len)
+{
+    return dispatch().find_newline(data, pos, len);
+}
+
+} // namespace lexer_simd
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+
+// Vectorized scanning loops of the lexer. The widest instruction set the CPU supports
+// is picked on first use: AVX2, SSE2, or plain scalar code on other targets.
+namespace lexer_simd {
+
+// Blanks are ' ', '\t', '\r', '\n' and '\0'
+inline bool is_blank(const char ch)
+{
+    return ch == ' ' || ch == '\n' || ch == '\t' || ch == '\r' || ch == '\0';
+}
+
+// Position of the first non-blank byte in [pos, len), len if there is none
+std::size_t skip_blanks(const char *data, std::size_t pos, const std::size_t len);
+
+// Position of the first '\n' in [pos, len), len if there is none
+std::size_t find_newline(const char *data, std::size_t pos, const std::size_t len);
+
+} // namespace lexer_simd
@@ -0,0 +1,30 @@
+#include <algorithm>
+
+#include "LineIndex.h"
+#include "LexerSimd.h"
+
+LineIndex::LineIndex(std::string_view source)
+{
+    line_starts.push_back(0);
+
+    std::size_t pos = 0;
+    while (true) {
+        pos = lexer_simd::find_newline(source.data(), pos, source.length());
+        if (pos >= source.length())
+            break;
+
+        pos += 1;
+        line_starts.push_back(static_cast<uint32_t>(pos));
+    }
+}
+
+SourceLocation LineIndex::locate(const uint32_t offset) const
+{
+    // The last line start at or before offset
+    auto line = std::upper_bound(line_starts.begin(), line_starts.end(), offset) - 1;
+
+    return SourceLocation{
+        static_cast<uint32_t>(line - line_starts.begin()) + 1,
+        offset - *line + 1,
+    };
+}
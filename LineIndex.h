@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+struct SourceLocation {
+    uint32_t line;   // From 1
+    uint32_t column; // From 1, in bytes
+};
+
+// Offsets of all line starts of a source, for turning token offsets into locations.
+// Built in one pass when it is first needed, lookups are a binary search.
+class LineIndex {
+    std::vector<uint32_t> line_starts;
+
+public:
+    explicit LineIndex(std::string_view source);
+
+    SourceLocation locate(const uint32_t offset) const;
+
+    std::size_t get_lines_count() const { return line_starts.size(); }
+};
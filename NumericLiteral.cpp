@@ -0,0 +1,55 @@
+#include <bit>
+#include <cstring>
+
+#include "NumericLiteral.h"
+
+namespace {
+
+// Eight ASCII digits in one 64-bit word, little-endian: the first digit in the lowest byte
+inline uint64_t parse_eight_digits(const char *digits)
+{
+    uint64_t chunk;
+    std::memcpy(&chunk, digits, sizeof(chunk));
+
+    if constexpr (std::endian::native != std::endian::little)
+        chunk = __builtin_bswap64(chunk);
+
+    chunk -= 0x3030303030303030ull;
+    chunk = (chunk * 10) + (chunk >> 8); // Pairs of digits
+    chunk = (((chunk & 0x000000ff000000ffull) * 0x000f424000000064ull) // 100 + (1000000 << 32)
+        + (((chunk >> 16) & 0x000000ff000000ffull) * 0x0000271000000001ull)) >> 32; // 1 + (10000 << 32)
+    return chunk;
+}
+
+} // namespace
+
+NumericLiteral NumericLiteral::decode(std::string_view digits)
+{
+    NumericLiteral literal{};
+
+    std::size_t i = 0;
+    bool overflows = false;
+
+    // Long runs go eight digits per step
+    for (; i + 8 <= digits.length(); i += 8) {
+        uint64_t shifted = 0;
+        overflows = overflows || __builtin_mul_overflow(literal.value, 100000000ull, &shifted);
+        overflows = overflows || __builtin_add_overflow(shifted, parse_eight_digits(digits.data() + i), &literal.value);
+    }
+    for (; i < digits.length(); i++) {
+        uint64_t shifted = 0;
+        overflows = overflows || __builtin_mul_overflow(literal.value, 10ull, &shifted);
+        overflows = overflows || __builtin_add_overflow(shifted, static_cast<uint64_t>(digits[i] - '0'), &literal.value);
+    }
+
+    if (overflows) {
+        literal.value = UINT64_MAX;
+        literal.overflows = true;
+    } else if (literal.value <= UINT8_MAX) {
+        literal.smallest_type = BasicType::U8;
+    } else if (literal.value <= UINT32_MAX) {
+        literal.smallest_type = BasicType::U32;
+    }
+
+    return literal;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string_view>
+#include <optional>
+#include <cstdint>
+
+#include "BasicType.h"
+
+struct NumericLiteral {
+    uint64_t value = 0;
+    // Smallest type that holds the value, none if it does not fit u32
+    std::optional<BasicType> smallest_type;
+    // The digits do not fit 64 bits, value is saturated then
+    bool overflows = false;
+
+    // digits are decimal digits only, as the lexer scans them
+    static NumericLiteral decode(std::string_view digits);
+};
@@ -1,456 +1,551 @@
-#include <numeric> // For std::accumulate
+#include <algorithm>
 
 #include "Parser.h"
+#include "ParserTables.h"
 
 #include "Lexer.h"
-#include "nlohmann/json.hpp"
 
-std::optional<GlobalStatementNode> Parser::parse_global_statement_at(const uint32_t requested_pos)
+namespace {
+
+// Only predicting alternatives and the operator precedence come from grammar, the sequences are
+// hand written. These are the rule bodies the functions below are written for, a rule changed in
+// grammar fails the build until its function and its body here are changed with it
+struct ImplementedRule {
+    grammar::Rule rule;
+    std::string_view body;
+};
+
+constexpr ImplementedRule implemented_rules[] = {
+    {grammar::Rule::PROGRAM, "(GlobalStatement)*"}, // parse_program
+    {grammar::Rule::GLOBAL_STATEMENT, "ProcedureDefinition | StaticVarDefinition"},
+    {grammar::Rule::STATIC_VAR_DEFINITION, "'staticvar' ID ':' BASIC_TYPE ';'"},
+    {grammar::Rule::PROCEDURE_DEFINITION, "'proc' ID '(' Parameters ')' '->' BASIC_TYPE Block"},
+    {grammar::Rule::PARAMETERS, "(Parameter (',' Parameter)*)?"}, // in parse_procedure_definition_at
+    {grammar::Rule::PARAMETER, "ID ':' BASIC_TYPE"},
+    {grammar::Rule::BLOCK, "'{' Statement* '}'"},
+    {grammar::Rule::STATEMENT, "(Expression ';') | ReturnStatement"},
+    {grammar::Rule::RETURN_STATEMENT, "'return' Expression ';'"}, // in parse_statement_at
+    // The expression rules down to Unary are levels of infix_binding_power
+    {grammar::Rule::EXPRESSION, "Sum (':=' Expression)?"},
+    {grammar::Rule::SUM, "Product (('+' | '-') Product)*"},
+    {grammar::Rule::PRODUCT, "Unary (('*' | '/') Unary)*"},
+    {grammar::Rule::UNARY, "(UnaryOperator Unary) | Postfix"},
+    {grammar::Rule::UNARY_OPERATOR, "'-' | '+' | '~'"}, // prefix_operator_of
+    {grammar::Rule::POSTFIX, "(ID ('(' Arguments ')')?) | NUMERIC_LITERAL | ('(' Expression ')')"}, // parse_operand_at
+    {grammar::Rule::ARGUMENTS, "(Expression (',' Expression)*)?"}, // parse_call_of
+};
+
+constexpr bool implements_grammar()
 {
-    // Try as procedure
-    std::optional<ProcedureDefinitionNode> try_proc = parse_procedure_definition_at(requested_pos);
-    if (try_proc.has_value()) {
-        return GlobalStatementNode(static_cast<ASTNode>(try_proc.value()));
+    if (std::size(implemented_rules) != std::size(grammar::BODIES))
+        return false;
+    for (std::size_t i = 0; i < std::size(implemented_rules); i++) {
+        if (static_cast<std::size_t>(implemented_rules[i].rule) != i || implemented_rules[i].body != grammar::BODIES[i])
+            return false;
     }
+    return true;
+}
 
-    // Try as global static var
-    std::optional<StaticVarDefinitionNode> try_staticvar = parse_static_var_definition_at(requested_pos);
-    if (try_staticvar.has_value()) {
-        return GlobalStatementNode(static_cast<ASTNode>(try_staticvar.value()));
-    }
+static_assert(implements_grammar(), "A rule of grammar changed, change its parse function and implemented_rules with it");
+
+} // namespace
 
-    return std::optional<GlobalStatementNode>(); // Parsing Failed
+uint32_t Parser::add_list_from(const std::size_t first)
+{
+    const uint32_t list = ast.add_list(std::span<const NodeId>(list_items).subspan(first));
+    list_items.resize(first);
+    return list;
 }
 
-std::optional<ProgramNode> Parser::parse_program()
+// GlobalStatement -> ProcedureDefinition | StaticVarDefinition
+std::optional<NodeId> Parser::parse_global_statement_at(const uint32_t pos)
 {
-    std::vector<GlobalStatementNode> globals{};
+    const Token::Type type = get_type_at(pos);
+
+    if (grammar::starts(grammar::Rule::PROCEDURE_DEFINITION, type))
+        return parse_procedure_definition_at(pos);
+
+    if (grammar::starts(grammar::Rule::STATIC_VAR_DEFINITION, type))
+        return parse_static_var_definition_at(pos);
+
+    return std::optional<NodeId>(); // Failed to parse
+}
+
+std::optional<NodeId> Parser::parse_program()
+{
+    const std::size_t globals = list_items.size();
+    const Ast::Mark entry = ast.mark();
     uint32_t current_pos = 0;
+
+    // The nodes never outgrow their room unless the tokens are still being lexed, lists may
+    if (feed == nullptr)
+        ast.reserve(ast.size() + Ast::estimate_nodes_count(tokens.size()));
     
-    while (current_pos < tokens.size()) {
-        std::optional<GlobalStatementNode> try_global = parse_global_statement_at(current_pos);
+    while (has_token_at(current_pos)) {
+        std::optional<NodeId> try_global = parse_global_statement_at(current_pos);
         if (!try_global.has_value()) {
-            return std::optional<ProgramNode>();
+            list_items.resize(globals);
+            ast.truncate(entry);
+            return std::optional<NodeId>();
         }
 
-        globals.push_back(try_global.value());
+        list_items.push_back(try_global.value());
+        current_pos = ast[try_global.value()].end_token;
     }
 
-    return ProgramNode(globals);
+    const uint32_t list = add_list_from(globals);
+    return ast.add({AstNode::Kind::PROGRAM, 0, 0, current_pos, list, 0});
 }
 
-std::optional<ProcedureDefinitionNode> Parser::parse_procedure_definition_at(const uint32_t requested_pos)
+std::optional<NodeId> Parser::parse_procedure_definition_at(const uint32_t requested_pos)
 {
     uint32_t current_pos = requested_pos;
 
-    // 'proc '
-    if (get_token_at(current_pos).type != Token::Type::PROC)
-        return std::optional<ProcedureDefinitionNode>(); // Failed to parse
+    // 'proc'
+    if (get_type_at(current_pos) != Token::Type::PROC)
+        return std::optional<NodeId>(); // Failed to parse
     current_pos += 1;
     
     // ID
     Token id_token = get_token_at(current_pos);
     if (id_token.type != Token::Type::ID)
-        return std::optional<ProcedureDefinitionNode>(); // Failed to parse
+        return std::optional<NodeId>(); // Failed to parse
+    current_pos += 1;
+
+    // '('
+    if (get_type_at(current_pos) != Token::Type::LPAREN)
+        return std::optional<NodeId>(); // Failed to parse
     current_pos += 1;
 
-    // () // params
-    std::optional<ParametersNode> params = parse_parameters_at(current_pos);
-    if (!params.has_value())
-        return std::optional<ProcedureDefinitionNode>(); // Failed to parse
-    current_pos += params.value().get_token_length();
+    // Parameters -> (Parameter (',' Parameter)*)?
+    const std::size_t params = list_items.size();
+    if (grammar::starts(grammar::Rule::PARAMETER, get_type_at(current_pos))) {
+        while (true) {
+            // expect Parameter
+            std::optional<NodeId> try_param = parse_parameter_at(current_pos);
+            if (!try_param.has_value())
+                return std::optional<NodeId>(); // Failed to parse
+            list_items.push_back(try_param.value());
+            current_pos = ast[try_param.value()].end_token;
+
+            // expect ','
+            if (get_type_at(current_pos) != Token::Type::COMMA)
+                break;
+            current_pos += 1;
+        }
+    }
+
+    // ')'
+    if (get_type_at(current_pos) != Token::Type::RPAREN)
+        return std::optional<NodeId>(); // Failed to parse
+    current_pos += 1;
     
     // ->
-    if (get_token_at(current_pos).type != Token::Type::RIGHTARROW)
-        return std::optional<ProcedureDefinitionNode>(); // Failed to parse
+    if (get_type_at(current_pos) != Token::Type::RIGHTARROW)
+        return std::optional<NodeId>(); // Failed to parse
     current_pos += 1;
 
     // return type
     std::optional<BasicType> ret_type = parse_basic_type_from_token(get_token_at(current_pos));
     if (!ret_type.has_value())
-        return std::optional<ProcedureDefinitionNode>(); // Failed to parse
+        return std::optional<NodeId>(); // Failed to parse
     current_pos += 1;
 
     // Block
-    std::optional<BlockNode> block = parse_block_at(current_pos);
+    std::optional<NodeId> block = parse_block_at(current_pos);
     if (!block.has_value())
-        return std::optional<ProcedureDefinitionNode>(); // Failed to parse
-    
+        return std::optional<NodeId>(); // Failed to parse
+    current_pos = ast[block.value()].end_token;
 
-    return ProcedureDefinitionNode(id_token.value, params.value(), ret_type.value(), block.value());
+    // The parameters list goes right after the block, see AstNode::Kind
+    const uint32_t block_and_params = ast.add_extra(block.value());
+    add_list_from(params);
+
+    return ast.add({AstNode::Kind::PROCEDURE_DEFINITION, static_cast<uint8_t>(ret_type.value()),
+                    requested_pos, current_pos, id_token.payload, block_and_params});
 }
 
-std::optional<StaticVarDefinitionNode> Parser::parse_static_var_definition_at(const uint32_t requested_pos)
+std::optional<NodeId> Parser::parse_static_var_definition_at(const uint32_t requested_pos)
 {
     uint32_t current_pos = requested_pos;
 
-    // expect 'staticvar '
-    if (get_token_at(current_pos).type != Token::Type::STATICVAR)
-        return std::optional<StaticVarDefinitionNode>(); // Failed to parse
+    // expect 'staticvar'
+    if (get_type_at(current_pos) != Token::Type::STATICVAR)
+        return std::optional<NodeId>(); // Failed to parse
     current_pos += 1;
 
     // expect id
     Token id_token = get_token_at(current_pos);
     if (id_token.type != Token::Type::ID)
-        return std::optional<StaticVarDefinitionNode>(); // Failed to parse
+        return std::optional<NodeId>(); // Failed to parse
     current_pos += 1;
 
     // expect ':'
-    if (get_token_at(current_pos).type != Token::Type::COLON)
-        return std::optional<StaticVarDefinitionNode>(); // Failed to parse
+    if (get_type_at(current_pos) != Token::Type::COLON)
+        return std::optional<NodeId>(); // Failed to parse
     current_pos += 1;
 
     // expect valid type
     std::optional<BasicType> ret_type = parse_basic_type_from_token(get_token_at(current_pos));
     if (!ret_type.has_value())
-        return std::optional<StaticVarDefinitionNode>(); // Failed to parse
+        return std::optional<NodeId>(); // Failed to parse
     current_pos += 1;
 
     // expect ';'
-    if (get_token_at(current_pos).type != Token::Type::SEMICOLON)
-        return std::optional<StaticVarDefinitionNode>(); // Failed to parse
+    if (get_type_at(current_pos) != Token::Type::SEMICOLON)
+        return std::optional<NodeId>(); // Failed to parse
     current_pos += 1;
 
-    return StaticVarDefinitionNode(id_token.value, ret_type.value());
+    return ast.add({AstNode::Kind::STATIC_VAR_DEFINITION, static_cast<uint8_t>(ret_type.value()),
+                    requested_pos, current_pos, id_token.payload, 0});
 }
 
-std::optional<ParameterNode> Parser::parse_parameter_at(const uint32_t pos)
+std::optional<NodeId> Parser::parse_parameter_at(const uint32_t pos)
 {
     uint32_t current_pos = pos;
 
     // expect 'ID'
     Token id_token = get_token_at(current_pos);
     if (id_token.type != Token::Type::ID)
-        return std::optional<ParameterNode>(); // Failed to parse
+        return std::optional<NodeId>(); // Failed to parse
     current_pos += 1;
 
     // expect ':'
-    if (get_token_at(current_pos).type != Token::Type::COLON)
-        return std::optional<ParameterNode>(); // Failed to parse
+    if (get_type_at(current_pos) != Token::Type::COLON)
+        return std::optional<NodeId>(); // Failed to parse
     current_pos += 1;
 
     // expect valid type
     std::optional<BasicType> ret_type = parse_basic_type_from_token(get_token_at(current_pos));
     if (!ret_type.has_value())
-        return std::optional<ParameterNode>(); // Failed to parse
+        return std::optional<NodeId>(); // Failed to parse
     current_pos += 1;
 
-    return ParameterNode(id_token.value, ret_type.value());
-}
-
-std::optional<ParametersNode> Parser::parse_parameters_at(const uint32_t pos)
-{
-    uint32_t current_pos = pos;
-    std::vector<ParameterNode> parameters_list{};
-
-    std::optional try_param = parse_parameter_at(current_pos);
-    if (try_param.has_value()) {
-        parameters_list.push_back(try_param.value());
-
-        while(true) {
-            // expect ','
-            if (get_token_at(current_pos).type != Token::Type::COMMA)
-                break;
-            current_pos += 1;  
-
-            // expect Parameter
-            try_param = parse_parameter_at(current_pos);
-            if (!try_param.has_value()) 
-                break;
-            parameters_list.push_back(try_param.value());
-            current_pos += try_param.value().get_token_length();  
-        }
-    }
-
-
-    return ParametersNode(parameters_list);
+    return ast.add({AstNode::Kind::PARAMETER, static_cast<uint8_t>(ret_type.value()),
+                    pos, current_pos, id_token.payload, 0});
 }
 
-std::optional<BlockNode> Parser::parse_block_at(const uint32_t requested_pos)
+// Block -> '{' Statement* '}'
+std::optional<NodeId> Parser::parse_block_at(const uint32_t requested_pos)
 {
     uint32_t current_pos = requested_pos;
 
     // expect '{'
-    if (get_token_at(current_pos).type != Token::Type::LCURLY)
-        return std::optional<BlockNode>(); // Failed to parse
+    if (get_type_at(current_pos) != Token::Type::LCURLY)
+        return std::optional<NodeId>(); // Failed to parse
     current_pos += 1;
 
     // parse statements
-    std::vector<StatementNode> statements;
-    while (true) {
-        std::optional<StatementNode> try_statement = parse_statement_at(current_pos);
+    const std::size_t statements = list_items.size();
+    while (grammar::starts(grammar::Rule::STATEMENT, get_type_at(current_pos))) {
+        std::optional<NodeId> try_statement = parse_statement_at(current_pos);
         if (!try_statement.has_value())
-            break;
-        statements.push_back(try_statement.value());
+            return std::optional<NodeId>(); // Failed to parse
+        list_items.push_back(try_statement.value());
+        current_pos = ast[try_statement.value()].end_token;
     }
     
     // expect '}'
-    if (get_token_at(current_pos).type != Token::Type::LCURLY)
-        return std::optional<BlockNode>(); // Failed to parse
+    if (get_type_at(current_pos) != Token::Type::RCURLY)
+        return std::optional<NodeId>(); // Failed to parse
     current_pos += 1;
 
-
-    return BlockNode(statements);
+    const uint32_t list = add_list_from(statements);
+    return ast.add({AstNode::Kind::BLOCK, 0, requested_pos, current_pos, list, 0});
 }
 
-std::optional<AssignmentNode> Parser::parse_assignment_at(const uint32_t requested_pos)
+// Statement -> (Expression ';') | ReturnStatement
+std::optional<NodeId> Parser::parse_statement_at(const uint32_t requested_pos)
 {
     uint32_t current_pos = requested_pos;
 
-    // expect ID
-    Token id_token = get_token_at(current_pos);
-    if (id_token.type != Token::Type::ID)
-        return std::optional<AssignmentNode>(); // Failed to parse
-    current_pos += 1;
-
-    // expect '='
-    if (get_token_at(current_pos).type != Token::Type::ASSIGN)
-        return std::optional<AssignmentNode>(); // Failed to parse
-    current_pos += 1;
-
-    // expect expr
-    std::optional<ExpressionNode> expr = parse_expression_at(current_pos);
-    if (!expr.has_value())
-        return std::optional<AssignmentNode>(); // Failed to parse
-    
-
-    return AssignmentNode(id_token.value, expr.value());
-}
-
-std::optional<StatementNode> Parser::parse_statement_at(const uint32_t requested_pos)
-{
-    uint32_t current_pos = requested_pos;
+    // ReturnStatement -> 'return' Expression ';'
+    const bool is_return_statement = grammar::starts(grammar::Rule::RETURN_STATEMENT, get_type_at(current_pos));
+    if (is_return_statement)
+        current_pos += 1;
 
     // expect expr
-    std::optional<ExpressionNode> expr = parse_expression_at(current_pos);
+    std::optional<NodeId> expr = parse_expression_at(current_pos);
     if (!expr.has_value())
-        return std::optional<StatementNode>(); // Failed to parse
+        return std::optional<NodeId>(); // Failed to parse
+    current_pos = ast[expr.value()].end_token;
     
     // expect ';'
-    if (get_token_at(current_pos).type != Token::Type::SEMICOLON)
-        return std::optional<StatementNode>(); // Failed to parse
+    if (get_type_at(current_pos) != Token::Type::SEMICOLON)
+        return std::optional<NodeId>(); // Failed to parse
     current_pos += 1;
 
-    // Return Nothing
-    return std::optional<StatementNode>();
+    const AstNode::Kind kind = is_return_statement ? AstNode::Kind::RETURN_STATEMENT : AstNode::Kind::EXPRESSION_STATEMENT;
+    return ast.add({kind, 0, requested_pos, current_pos, expr.value(), 0});
 }
 
-std::optional<ExpressionNode> Parser::parse_expression_at(const uint32_t requested_pos)
-{
-    // Try assingment
-    std::optional<AssignmentNode> try_assign = parse_assignment_at(requested_pos);
-    if (try_assign.has_value()) {
-        return ExpressionNode(try_assign.value());
-    }
-
-    // Try Sum
-    std::optional<SumNode> try_sum = parse_sum_at(requested_pos);
-    if (try_sum.has_value()) {
-        return ExpressionNode(try_sum.value());
-    }
+namespace {
 
-    // Try Sub
-    std::optional<SubNode> try_sub = parse_sub_at(requested_pos);
-    if (try_sub.has_value()) {
-        return ExpressionNode(try_sub.value());
-    }
+struct BindingPower {
+    uint8_t left;
+    uint8_t right;
+};
 
-    // Try as single Term
-    std::optional<TermNode> try_term = parse_term_at(requested_pos);
-    if (try_term.has_value()) {
-        return ExpressionNode(try_term.value());
+// Infix and postfix operators. An operator takes the expression on its left if its left power is at
+// least the one the caller asked for, its right operand is parsed with its right power.
+// Right above left associates to the left, ':=' associates to the right
+constexpr BindingPower infix_binding_power(const Token::Type type)
+{
+    switch (type) {
+    case Token::Type::ASSIGN:
+        return {2, 1};
+    case Token::Type::PLUS:
+    case Token::Type::MINUS:
+        return {3, 4};
+    case Token::Type::ASTERISK:
+    case Token::Type::SLASH:
+        return {5, 6};
+    case Token::Type::LPAREN: // call
+        return {9, 0};
+    default:
+        return {0, 0}; // Ends the expression
     }
-
-    return std::optional<ExpressionNode>();
 }
 
-std::optional<SumNode> Parser::parse_sum_at(const uint32_t pos)
-{
-    std::optional<TermNode> try_term = parse_term_at(pos);
-    if (!try_term.has_value())
-        return std::optional<SumNode>(); // Nothing
-
-    if (get_token_at(pos + try_term.value().get_token_length()).type != Token::Type::PLUS)
-        return std::optional<SumNode>(); // Nothing
-
-    std::optional<ExpressionNode> try_expr = parse_expression_at(
-        pos + try_term.value().get_token_length() + 1
-    );
-    if (!try_expr.has_value())
-        return std::optional<SumNode>(); // Nothing
-    
-    return SumNode(try_term.value(), try_expr.value());
-}
+// Unary + - ~ bind tighter than any binary operator, looser than a call
+constexpr uint8_t PREFIX_BINDING_POWER = 7;
 
-std::optional<SubNode> Parser::parse_sub_at(const uint32_t pos)
+constexpr std::optional<UnaryOperator> prefix_operator_of(const Token::Type type)
 {
-    std::optional<TermNode> try_term = parse_term_at(pos);
-    if (!try_term.has_value())
-        return std::optional<SubNode>(); // Nothing
-
-    if (get_token_at(pos + try_term.value().get_token_length()).type != Token::Type::MINUS)
-        return std::optional<SubNode>(); // Nothing
-
-    std::optional<ExpressionNode> try_expr = parse_expression_at(
-        pos + try_term.value().get_token_length() + 1
-    );
-    if (!try_expr.has_value())
-        return std::optional<SubNode>(); // Nothing
-    
-    return SubNode(try_term.value(), try_expr.value());
+    switch (type) {
+    case Token::Type::PLUS:
+        return UnaryOperator::PLUS;
+    case Token::Type::MINUS:
+        return UnaryOperator::MINUS;
+    case Token::Type::TILDA:
+        return UnaryOperator::NOT;
+    default:
+        return std::nullopt;
+    }
 }
 
-// Term -> (UnOp Primary) | Primary
-std::optional<TermNode> Parser::parse_term_at(const uint32_t pos)
+// The powers above have to order the operators the way the expression rules of grammar nest them,
+// see grammar::infix_level. A call is no rule level, it binds tighter than all of them
+constexpr bool binding_powers_match_grammar()
 {
-    if (
-        get_token_at(pos).type == Token::Type::PLUS 
-        || get_token_at(pos).type == Token::Type::MINUS
-        || get_token_at(pos).type == Token::Type::TILDA
-    ) {
-        std::optional<PrimaryNode> try_primary = parse_primary_at(pos + 1);
-        if (try_primary.has_value()) {
-            switch (get_token_at(pos).type)
-            {
-            case Token::Type::PLUS: 
-                return TermNode(try_primary.value(), UnaryOperator::PLUS);
-            case Token::Type::MINUS: 
-                return TermNode(try_primary.value(), UnaryOperator::MINUS);
-            case Token::Type::TILDA: 
-                return TermNode(try_primary.value(), UnaryOperator::NOT);
-            default:
-                break;
-            }
+    for (const Token::Type type : magic_enum::enum_values<Token::Type>()) {
+        if (((grammar::PREFIX_OPERATORS & grammar::bit(type)) != 0) != prefix_operator_of(type).has_value())
+            return false;
+
+        const BindingPower power = infix_binding_power(type);
+        const uint8_t level = grammar::infix_level(type);
+        if (type == Token::Type::LPAREN) {
+            if (level != 0 || power.left <= PREFIX_BINDING_POWER)
+                return false;
+            continue;
         }
-    }
-    else {
-        std::optional<PrimaryNode> try_primary = parse_primary_at(pos);
-        if (try_primary.has_value()) {
-            return TermNode(try_primary.value());
+        if ((level != 0) != (power.left != 0))
+            return false;
+        if (level == 0)
+            continue;
+
+        const bool right_associative = (grammar::RIGHT_ASSOCIATIVE & grammar::bit(type)) != 0;
+        if (right_associative != (power.right < power.left)
+            || (level < grammar::PREFIX_LEVEL) != (power.left < PREFIX_BINDING_POWER))
+            return false;
+
+        for (const Token::Type other : magic_enum::enum_values<Token::Type>()) {
+            const uint8_t other_level = grammar::infix_level(other);
+            const uint8_t other_left = infix_binding_power(other).left;
+            if (other_level != 0 && ((level < other_level) != (power.left < other_left)
+                                     || (level == other_level) != (power.left == other_left)))
+                return false;
         }
     }
-
-    // Return Nothing else
-    return std::optional<TermNode>();
+    return true;
 }
 
-std::optional<PrimaryNode> Parser::parse_primary_at(const uint32_t pos)
+static_assert(binding_powers_match_grammar(), "infix_binding_power or the prefix operators disagree with grammar");
+
+std::optional<BinaryOperator> binary_operator_of(const Token::Type type)
 {
-    if (
-        get_token_at(pos).type == Token::Type::ID
-        || get_token_at(pos).type == Token::Type::NUMERIC_LITERAL
-    ) {
-        return PrimaryNode(get_token_at(pos));
+    switch (type) {
+    case Token::Type::PLUS:
+        return BinaryOperator::ADD;
+    case Token::Type::MINUS:
+        return BinaryOperator::SUBTRACT;
+    case Token::Type::ASTERISK:
+        return BinaryOperator::MULTIPLY;
+    case Token::Type::SLASH:
+        return BinaryOperator::DIVIDE;
+    default:
+        return std::nullopt;
     }
-    
-    // Return Nothing else
-    return std::optional<PrimaryNode>();
 }
 
-Token Parser::get_token_at(const uint32_t pos)
+} // namespace
+
+std::optional<NodeId> Parser::parse_expression_at(const uint32_t pos)
 {
-    return Token();
+    return parse_expression_with_power_at(pos, 0);
 }
 
-std::optional<Parser::BasicType> Parser::parse_basic_type_from_token(const Token token)
+// Precedence climbing: one operand, then every operator that binds at least min_power, left to right.
+// Every token is looked at once, nothing is parsed again
+std::optional<NodeId> Parser::parse_expression_with_power_at(const uint32_t pos, const uint8_t min_power)
 {
-    if (token.type != Token::Type::BASIC_TYPE)
-        return std::optional<BasicType>();
+    std::optional<NodeId> left = parse_operand_at(pos);
+    if (!left.has_value())
+        return std::optional<NodeId>(); // Failed to parse
+    uint32_t current_pos = ast[left.value()].end_token;
 
-    if (token.value == "u8")
-        return BasicType::U8;
-    else if (token.value == "u32")
-        return BasicType::U32;
-    else if (token.value == "nil")
-        return BasicType::NIL;
-    else {
-        // Incorrect type
-        return std::optional<Parser::BasicType>();
+    while (true) {
+        const Token::Type operator_type = get_type_at(current_pos);
+        const BindingPower power = infix_binding_power(operator_type);
+        if (power.left == 0 || power.left < min_power)
+            break;
+
+        // Only a bare identifier can be called or assigned to
+        const bool left_is_identifier = ast[left.value()].kind == AstNode::Kind::IDENTIFIER;
+
+        if (operator_type == Token::Type::LPAREN) {
+            if (!left_is_identifier)
+                break;
+            left = parse_call_of(left.value());
+            if (!left.has_value())
+                return std::optional<NodeId>(); // Failed to parse
+            current_pos = ast[left.value()].end_token;
+            continue;
+        }
+
+        if (operator_type == Token::Type::ASSIGN && !left_is_identifier)
+            return std::optional<NodeId>(); // Failed to parse
+
+        std::optional<NodeId> right = parse_expression_with_power_at(current_pos + 1, power.right);
+        if (!right.has_value())
+            return std::optional<NodeId>(); // Failed to parse
+        current_pos = ast[right.value()].end_token;
+
+        if (operator_type == Token::Type::ASSIGN)
+            left = ast.add({AstNode::Kind::ASSIGNMENT, 0, pos, current_pos, left.value(), right.value()});
+        else
+            left = ast.add({AstNode::Kind::BINARY_OPERATION, static_cast<uint8_t>(binary_operator_of(operator_type).value()),
+                            pos, current_pos, left.value(), right.value()});
     }
-}
 
-uint32_t ExpressionNode::get_token_length() const
-{
-    return child.get_token_length();
+    return left;
 }
 
-uint32_t StatementNode::get_token_length() const
+// Operand -> UnOp Operand | '(' Expression ')' | ID | NUMERIC_LITERAL
+std::optional<NodeId> Parser::parse_operand_at(const uint32_t pos)
 {
-    return 1 + expr.get_token_length();
-}
+    switch (get_type_at(pos)) {
+    case Token::Type::ID:
+        return ast.add({AstNode::Kind::IDENTIFIER, 0, pos, pos + 1, get_token_at(pos).payload, 0});
+
+    case Token::Type::NUMERIC_LITERAL:
+        return ast.add({AstNode::Kind::NUMERIC_LITERAL, 0, pos, pos + 1, get_token_at(pos).payload, 0});
+
+    case Token::Type::PLUS:
+    case Token::Type::MINUS:
+    case Token::Type::TILDA: {
+        std::optional<NodeId> operand = parse_expression_with_power_at(pos + 1, PREFIX_BINDING_POWER);
+        if (!operand.has_value())
+            return std::optional<NodeId>(); // Failed to parse
+
+        const UnaryOperator unary_operator = prefix_operator_of(get_type_at(pos)).value();
+        return ast.add({AstNode::Kind::UNARY_OPERATION, static_cast<uint8_t>(unary_operator),
+                        pos, ast[operand.value()].end_token, operand.value(), 0});
+    }
 
-uint32_t AssignmentNode::get_token_length() const
-{
-    return 2 + expr.get_token_length();
-}
+    case Token::Type::LPAREN: {
+        std::optional<NodeId> inner = parse_expression_at(pos + 1);
+        if (!inner.has_value())
+            return std::optional<NodeId>(); // Failed to parse
 
-uint32_t SumNode::get_token_length() const
-{
-    return left_term.get_token_length() + 1 + right_expr.get_token_length();
-}
+        // expect ')'
+        const uint32_t close_pos = ast[inner.value()].end_token;
+        if (get_type_at(close_pos) != Token::Type::RPAREN)
+            return std::optional<NodeId>(); // Failed to parse
+        return ast.add({AstNode::Kind::PARENTHESIZED, 0, pos, close_pos + 1, inner.value(), 0});
+    }
 
-uint32_t SubNode::get_token_length() const
-{
-    return left_term.get_token_length() + 1 + right_expr.get_token_length();
+    default:
+        return std::optional<NodeId>(); // Failed to parse
+    }
 }
 
-uint32_t TermNode::get_token_length() const
+// Call -> ID '(' (Expression (',' Expression)*)? ')'
+std::optional<NodeId> Parser::parse_call_of(const NodeId callee)
 {
-    return primary.get_token_length() + (unOp == UnaryOperator::NONE ? 0 : 1);
-}
+    const uint32_t pos = ast[callee].first_token;
+    uint32_t current_pos = ast[callee].end_token;
 
-uint32_t PrimaryNode::get_token_length() const
-{
-    return 1;
-}
+    // expect '('
+    if (get_type_at(current_pos) != Token::Type::LPAREN)
+        return std::optional<NodeId>(); // Failed to parse
+    current_pos += 1;
 
-uint32_t BlockNode::get_token_length() const
-{
-    return 2 + std::accumulate(statements.begin(), statements.end(), 0, [](int acc, StatementNode st) {
-        return acc + st.get_token_length();
-    });
-}
+    const std::size_t arguments = list_items.size();
+    if (get_type_at(current_pos) != Token::Type::RPAREN) {
+        while (true) {
+            std::optional<NodeId> argument = parse_expression_at(current_pos);
+            if (!argument.has_value())
+                return std::optional<NodeId>(); // Failed to parse
+            list_items.push_back(argument.value());
+            current_pos = ast[argument.value()].end_token;
 
-uint32_t ParameterNode::get_token_length() const
-{
-    return 3;
-}
+            // expect ','
+            if (get_type_at(current_pos) != Token::Type::COMMA)
+                break;
+            current_pos += 1;
+        }
+    }
 
-uint32_t ParametersNode::get_token_length() const
-{
-    // Summ all the lengths of parameters and add COMMAS between them
-    return 2 + std::accumulate(params.begin(), params.end(), 0, [](int sum, ParameterNode p) {
-        return sum + p.get_token_length();
-    }) + std::min(0, static_cast<int>(params.size() - 1)); // TODO 
-}
+    // expect ')'
+    if (get_type_at(current_pos) != Token::Type::RPAREN)
+        return std::optional<NodeId>(); // Failed to parse
+    current_pos += 1;
 
-uint32_t GlobalStatementNode::get_token_length() const
-{
-    return child.get_token_length();
+    const uint32_t list = add_list_from(arguments);
+    return ast.add({AstNode::Kind::CALL, 0, pos, current_pos, callee, list});
 }
 
-uint32_t ProcedureDefinitionNode::get_token_length() const
+bool Parser::has_token_at(const uint32_t pos)
 {
-    return 3 + parameters.get_token_length() + instructions_block.get_token_length();
+    while (pos >= tokens.size()) {
+        if (feed == nullptr || !feed->next())
+            return false;
+    }
+    return true;
 }
 
-uint32_t StaticVarDefinitionNode::get_token_length() const
+Token Parser::get_token_at(const uint32_t pos)
 {
-    return 5;
+    furthest_pos = std::max(furthest_pos, pos);
+    if (!has_token_at(pos))
+        return Token();
+
+    return tokens[pos];
 }
 
-uint32_t ProgramNode::get_token_length() const
+Token::Type Parser::get_type_at(const uint32_t pos)
 {
-    return std::accumulate(global_statements.begin(), global_statements.end(), 0, [](int sum, GlobalStatementNode gs) {
-        return sum += gs.get_token_length();
-    });
+    furthest_pos = std::max(furthest_pos, pos);
+    if (!has_token_at(pos))
+        return Token::Type::NONE;
+
+    return tokens.type_at(pos);
 }
 
-uint32_t ASTNode::get_token_length() const
+std::optional<Parser::BasicType> Parser::parse_basic_type_from_token(const Token token)
 {
-    return 0;
-}
+    if (token.type != Token::Type::BASIC_TYPE)
+        return std::optional<BasicType>();
 
-// nlohmann::json ASTNode::generate_json() {
-//     return nlohmann::json::array();
-// }
\ No newline at end of file
+    if (get_token_value(token) == "u8")
+        return BasicType::U8;
+    else if (get_token_value(token) == "u32")
+        return BasicType::U32;
+    else if (get_token_value(token) == "nil")
+        return BasicType::NIL;
+    else {
+        // Incorrect type
+        return std::optional<Parser::BasicType>();
+    }
+}
@@ -1,223 +1,69 @@
 #pragma once
 
-#include <numeric> // For std::accumulate
-
 #include <vector>
 #include <optional>
 
 #include "Lexer.h"
-#include "nlohmann/json.hpp"
-
-enum class UnaryOperator {
-    NONE,
-    PLUS,
-    MINUS,
-    NOT
-};
-
-class ASTNode {
-public:
-    // To make the class polymorph to use dynamic_cast
-    virtual ~ASTNode() = default;
-
-    virtual uint32_t get_token_length() const;
-    // virtual nlohmann::json generate_json() const;
-};
-
-// Forwards
-class ProgramNode;
-class GlobalStatementNode;
-class ProcedureDefinitionNode;
-class StaticVarDefinitionNode;
-class ParametersNode;
-class BlockNode;
-class StatementNode;
-class ExpressionNode;
-class AssignmentNode;
-class SumNode;
-class SubNode;
-class TermNode;
-class PrimaryNode;
-class ParameterNode;
-
+#include "Interner.h"
+#include "BasicType.h"
+#include "Generator.h"
+#include "Ast.h"
 
 class Parser {
 public:
-    enum class BasicType {
-        NIL,
-        U8,
-        U32,
-    };
+    using BasicType = ::BasicType;
 
-    std::optional<ProgramNode> parse_program();
+    // Adds the nodes to the tree and returns the PROGRAM node, no value if the tokens are not a program
+    std::optional<NodeId> parse_program();
 
-    Parser(std::vector<Token> t) : tokens(t) {};
-private:
-    std::vector<Token> tokens;
+    // Token a failed parse_program() stopped at, tokens.size() if the tokens ended too early.
+    // Nothing is parsed twice, so it is the furthest token looked at
+    uint32_t get_failure_pos() const { return furthest_pos; }
 
-    std::optional<GlobalStatementNode> parse_global_statement_at(const uint32_t pos);
-    std::optional<ProcedureDefinitionNode> parse_procedure_definition_at(const uint32_t pos);
-    std::optional<StaticVarDefinitionNode> parse_static_var_definition_at(const uint32_t pos);
-    std::optional<ParameterNode> parse_parameter_at(const uint32_t pos);
-    std::optional<ParametersNode> parse_parameters_at(const uint32_t pos);
-    std::optional<BlockNode> parse_block_at(const uint32_t pos);
-    std::optional<StatementNode> parse_statement_at(const uint32_t pos);
-    std::optional<ExpressionNode> parse_expression_at(const uint32_t pos);
-    std::optional<AssignmentNode> parse_assignment_at(const uint32_t pos);
-    std::optional<SumNode> parse_sum_at(const uint32_t pos);
-    std::optional<SubNode> parse_sub_at(const uint32_t pos);
-    std::optional<TermNode> parse_term_at(const uint32_t pos);
-    std::optional<PrimaryNode> parse_primary_at(const uint32_t pos);
+    // source_text is the buffer the tokens point into, it has to outlive the parser.
+    // With a feed, e.g. Lexer::tokenize_lazily(), tokens are lexed as the parser reaches them,
+    // the feed has to append them to t
+    Parser(const TokenStream &t, std::string_view source, Ast &tree, Generator<Token> *token_feed = nullptr)
+        : tokens(t), source_text(source), ast(tree), feed(token_feed) {};
+private:
+    const TokenStream &tokens;
+    std::string_view source_text;
+    Ast &ast;
+    Generator<Token> *feed;
+    uint32_t furthest_pos = 0;
+
+    // Children of the lists being parsed, nested lists stack up. A list is moved into the tree
+    // once it is complete
+    std::vector<NodeId> list_items;
+
+    // Moves list_items from first on into the tree
+    uint32_t add_list_from(const std::size_t first);
+
+    // Pulls tokens from the feed until pos exists. Returns false if the input ends first
+    bool has_token_at(const uint32_t pos);
+
+    // Every rule returns the node it added, the tokens after it start at ast[node].end_token.
+    // Alternatives are picked by their FIRST sets and never retried, so no rule is parsed twice
+    // at a position and results need no memo
+    std::optional<NodeId> parse_global_statement_at(const uint32_t pos);
+    std::optional<NodeId> parse_procedure_definition_at(const uint32_t pos);
+    std::optional<NodeId> parse_static_var_definition_at(const uint32_t pos);
+    std::optional<NodeId> parse_parameter_at(const uint32_t pos);
+    std::optional<NodeId> parse_block_at(const uint32_t pos);
+    std::optional<NodeId> parse_statement_at(const uint32_t pos);
+    std::optional<NodeId> parse_expression_at(const uint32_t pos);
+
+    // Expression whose operators bind at least min_power, see infix_binding_power in Parser.cpp
+    std::optional<NodeId> parse_expression_with_power_at(const uint32_t pos, const uint8_t min_power);
+    std::optional<NodeId> parse_operand_at(const uint32_t pos);
+    // The arguments of a call to callee, an IDENTIFIER node
+    std::optional<NodeId> parse_call_of(const NodeId callee);
 
     Token get_token_at(const uint32_t pos);
+    // Lookahead only touches the packed type array, NONE past the end
+    Token::Type get_type_at(const uint32_t pos);
     std::optional<BasicType> parse_basic_type_from_token(const Token token);
 
-};
-
-// TODO: slicind
-class ExpressionNode : public ASTNode {
-    ASTNode child;
-public:
-    ExpressionNode(ASTNode c) : child(c) {};
-
-    virtual uint32_t get_token_length() const override;
-    // virtual nlohmann::json generate_json() const override;
-};
-
-class StatementNode : public ASTNode {
-    ExpressionNode expr;
-    bool is_return_statement = false;
-public:
-    StatementNode(ExpressionNode e, bool ret_st = false) : expr(e), is_return_statement(ret_st) {};
-
-    virtual uint32_t get_token_length() const override;
-    // virtual nlohmann::json generate_json() const override;
+    std::string_view get_token_value(const Token token) const { return token.value_in(source_text); }
 
 };
-
-class PrimaryNode : public ASTNode {
-    Token token;
-public:
-    PrimaryNode(Token t) : token(t) {};
-
-    virtual uint32_t get_token_length() const override;
-    // nlohmann::json generate_json() const override;
-};
-
-class TermNode : public ASTNode {
-    PrimaryNode primary;
-    UnaryOperator unOp = UnaryOperator::NONE;
-public:
-    TermNode(PrimaryNode p, UnaryOperator uo = UnaryOperator::NONE) : primary(p), unOp(uo) {};
-
-    virtual uint32_t get_token_length() const override;
-    // nlohmann::json generate_json() const override;
-};
-
-class AssignmentNode : public ASTNode {
-    std::string id;
-    ExpressionNode expr;
-public:
-    AssignmentNode(std::string ID, ExpressionNode e) : id(ID), expr(e) {};
-
-    virtual uint32_t get_token_length() const override;
-    // nlohmann::json generate_json() const override;
-};
-
-class SumNode : public ASTNode {
-    TermNode left_term;
-    ExpressionNode right_expr;
-public:
-    SumNode(TermNode t, ExpressionNode e) : left_term(t), right_expr(e) {};
-
-    virtual uint32_t get_token_length() const override;
-    // nlohmann::json generate_json() const override;
-};
-
-class SubNode : public ASTNode {
-    TermNode left_term;
-    ExpressionNode right_expr;
-public:
-    SubNode(TermNode t, ExpressionNode e) : left_term(t), right_expr(e) {};
-
-    virtual uint32_t get_token_length() const override;
-    // nlohmann::json generate_json() const override;
-};
-
-
-
-
-class BlockNode : public ASTNode {
-    std::vector<StatementNode> statements;
-
-public:
-    BlockNode(std::vector<StatementNode> s) : statements(s) {};
-
-    virtual uint32_t get_token_length() const override;
-    // nlohmann::json generate_json() const override;
-};
-
-
-class ParameterNode : public ASTNode {
-    std::string param_id;
-    Parser::BasicType param_type;
-public:
-    ParameterNode(std::string id, Parser::BasicType t) : param_id(id), param_type(t) {};
-
-    virtual uint32_t get_token_length() const override;
-    // nlohmann::json generate_json() const override;
-};
-
-class ParametersNode : public ASTNode {
-    std::vector<ParameterNode> params;
-public:
-    ParametersNode(std::vector<ParameterNode> p) : params(p) {};
-
-    virtual uint32_t get_token_length() const override;
-    // nlohmann::json generate_json() const override;
-};
-
-class GlobalStatementNode : public ASTNode {
-    ASTNode child;
-public:
-    GlobalStatementNode(ASTNode c) : child(c) {};
-
-    virtual uint32_t get_token_length() const override;
-    // nlohmann::json generate_json() const override;
-};
-
-class ProcedureDefinitionNode : public ASTNode {
-    std::string proc_id;
-    ParametersNode parameters;
-    Parser::BasicType return_type;
-    BlockNode instructions_block;
-public:
-    ProcedureDefinitionNode(std::string id, ParametersNode p, Parser::BasicType ret, BlockNode b)
-        : proc_id(id), parameters(p), return_type(ret), instructions_block(b) {};
-
-    virtual uint32_t get_token_length() const override;
-    // nlohmann::json generate_json() const override;
-};
-
-class StaticVarDefinitionNode : public ASTNode {
-    std::string var_id;
-    Parser::BasicType var_type;
-
-public:
-    StaticVarDefinitionNode(std::string new_id, Parser::BasicType new_type)
-        : var_id(new_id), var_type(new_type) {};
-
-    virtual uint32_t get_token_length() const override;
-    // nlohmann::json generate_json() const override;
-};
-
-
-class ProgramNode : public ASTNode {
-    std::vector<GlobalStatementNode> global_statements;
-public:
-    ProgramNode(std::vector<GlobalStatementNode> glob_s) : global_statements(glob_s){};
-
-    virtual uint32_t get_token_length() const override;
-    // nlohmann::json generate_json() const override;
-};
-
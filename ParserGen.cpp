@@ -0,0 +1,579 @@
+// Reads the grammar file, checks that one token of lookahead picks every alternative
+// and writes the FIRST sets of its rules, the operator precedence its expression rules
+// encode and the text of every rule body into a header for Parser.cpp. The parse functions
+// stay hand written, Parser.cpp checks at compile time that they are written for these bodies.
+//
+// The grammar is one rule per line, Name -> body. A body is made of 'literal' terminals,
+// TOKEN_TYPE terminals, Rule names, ( ) groups, | alternatives and the * ? + suffixes.
+// Lines starting with # are comments.
+
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cstdint>
+#include <cctype>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <array>
+#include <optional>
+
+#include "Lexer.h"
+#include "SourceFile.h"
+#include "magic_enum.hpp"
+
+namespace {
+
+// Terminals are token types, NONE stands for the end of the tokens
+using TokenSet = uint64_t;
+static_assert(magic_enum::enum_count<Token::Type>() <= 64, "Token types have to fit into a TokenSet");
+
+constexpr TokenSet bit(const Token::Type type) { return TokenSet{1} << static_cast<unsigned>(type); }
+
+struct Symbol {
+    bool is_terminal;
+    // Token::Type of a terminal, index into Grammar::rules of a nonterminal
+    uint32_t id;
+};
+
+using Sequence = std::vector<Symbol>;
+
+struct Rule {
+    std::string name;
+    // Rules made up for groups and suffixes have no name of their own in the header
+    bool is_named;
+    uint32_t line;
+    // As written in the grammar file with blanks collapsed, empty for made up rules
+    std::string body;
+    std::vector<Sequence> alternatives;
+
+    bool nullable = false;
+    TokenSet first = 0;
+    TokenSet follow = 0;
+};
+
+struct Grammar {
+    std::string file_name;
+    std::vector<Rule> rules;
+    std::map<std::string, uint32_t, std::less<>> rule_ids;
+};
+
+[[noreturn]] void fail(const Grammar &grammar, const uint32_t line, const std::string &message)
+{
+    std::cerr << grammar.file_name << ":" << line << ": " << message << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+uint32_t add_rule(Grammar &grammar, std::string name, const bool is_named, const uint32_t line)
+{
+    grammar.rules.push_back(Rule{std::move(name), is_named, line, {}, {}});
+    return static_cast<uint32_t>(grammar.rules.size() - 1);
+}
+
+// Recursive descent over the body of one rule. Groups and suffixes become rules of their own
+class BodyParser {
+    Grammar &grammar;
+    const uint32_t rule_id;
+    const uint32_t line;
+    std::string_view text;
+    std::size_t pos = 0;
+    uint32_t helpers_count = 0;
+
+    void skip_blanks() {
+        while (pos < text.length() && std::isspace(static_cast<unsigned char>(text[pos])))
+            pos++;
+    }
+
+    bool at(const char ch) {
+        skip_blanks();
+        return pos < text.length() && text[pos] == ch;
+    }
+
+    uint32_t add_helper() {
+        const std::string &owner = grammar.rules[rule_id].name;
+        return add_rule(grammar, owner + "#" + std::to_string(++helpers_count), false, line);
+    }
+
+    Symbol parse_terminal_literal() {
+        const std::size_t close = text.find('\'', pos + 1);
+        if (close == std::string_view::npos)
+            fail(grammar, line, "unterminated literal");
+        const std::string_view spelling = text.substr(pos + 1, close - pos - 1);
+        pos = close + 1;
+
+        // A literal is spelled the way the lexer reads it, as exactly one token
+        const Token token = Lexer::scan_with_dfa(spelling, 0);
+        if (token.type == Token::Type::NONE || token.type == Token::Type::ID || token.length != spelling.length())
+            fail(grammar, line, "'" + std::string(spelling) + "' is not a punctuator or a reserved word");
+        return Symbol{true, static_cast<uint32_t>(token.type)};
+    }
+
+    Symbol parse_name() {
+        const std::size_t begin = pos;
+        while (pos < text.length() && (std::isalnum(static_cast<unsigned char>(text[pos])) || text[pos] == '_'))
+            pos++;
+        const std::string_view name = text.substr(begin, pos - begin);
+
+        if (auto rule = grammar.rule_ids.find(name); rule != grammar.rule_ids.end())
+            return Symbol{false, rule->second};
+        if (std::optional<Token::Type> type = magic_enum::enum_cast<Token::Type>(name))
+            return Symbol{true, static_cast<uint32_t>(type.value())};
+        fail(grammar, line, "unknown rule or token type " + std::string(name));
+    }
+
+    // Atom -> '(' Alternatives ')' | 'literal' | NAME
+    Sequence parse_atom() {
+        skip_blanks();
+        if (pos >= text.length())
+            fail(grammar, line, "unexpected end of the rule");
+
+        if (text[pos] == '(') {
+            pos++;
+            std::vector<Sequence> alternatives = parse_alternatives();
+            if (!at(')'))
+                fail(grammar, line, "expected )");
+            pos++;
+            if (alternatives.size() == 1)
+                return alternatives.front();
+
+            const uint32_t group = add_helper();
+            grammar.rules[group].alternatives = std::move(alternatives);
+            return Sequence{Symbol{false, group}};
+        }
+        if (text[pos] == '\'')
+            return Sequence{parse_terminal_literal()};
+        if (std::isalpha(static_cast<unsigned char>(text[pos])) || text[pos] == '_')
+            return Sequence{parse_name()};
+        fail(grammar, line, std::string("unexpected ") + text[pos]);
+    }
+
+    // Item -> Atom ('*' | '?' | '+')?
+    Sequence parse_item() {
+        Sequence atom = parse_atom();
+        skip_blanks();
+        if (pos >= text.length() || (text[pos] != '*' && text[pos] != '?' && text[pos] != '+'))
+            return atom;
+        const char suffix = text[pos++];
+
+        // X* -> X X* | nothing, X? -> X | nothing, X+ -> X X*
+        const uint32_t helper = add_helper();
+        Sequence repeated = atom;
+        if (suffix != '?')
+            repeated.push_back(Symbol{false, helper});
+        grammar.rules[helper].alternatives = {repeated, Sequence{}};
+
+        if (suffix != '+')
+            return Sequence{Symbol{false, helper}};
+        atom.push_back(Symbol{false, helper});
+        return atom;
+    }
+
+    Sequence parse_sequence() {
+        Sequence sequence{};
+        while (!at('|') && !at(')') && pos < text.length()) {
+            Sequence item = parse_item();
+            sequence.insert(sequence.end(), item.begin(), item.end());
+        }
+        return sequence;
+    }
+
+    std::vector<Sequence> parse_alternatives() {
+        std::vector<Sequence> alternatives{parse_sequence()};
+        while (at('|')) {
+            pos++;
+            alternatives.push_back(parse_sequence());
+        }
+        return alternatives;
+    }
+
+public:
+    BodyParser(Grammar &g, const uint32_t id, const uint32_t l, std::string_view body)
+        : grammar(g), rule_id(id), line(l), text(body) {}
+
+    void parse() {
+        std::vector<Sequence> alternatives = parse_alternatives();
+        skip_blanks();
+        if (pos < text.length())
+            fail(grammar, line, std::string("unexpected ") + text[pos]);
+        grammar.rules[rule_id].alternatives = std::move(alternatives);
+    }
+};
+
+std::string collapse_blanks(std::string_view text)
+{
+    std::string collapsed{};
+    for (const char ch : text) {
+        if (!std::isspace(static_cast<unsigned char>(ch)))
+            collapsed += ch;
+        else if (!collapsed.empty() && collapsed.back() != ' ')
+            collapsed += ' ';
+    }
+    if (!collapsed.empty() && collapsed.back() == ' ')
+        collapsed.pop_back();
+    return collapsed;
+}
+
+Grammar read_grammar(const std::string &file_name, std::string_view text)
+{
+    Grammar grammar{file_name, {}, {}};
+
+    struct Line {
+        uint32_t number;
+        std::string_view body;
+    };
+    std::vector<std::pair<uint32_t, Line>> bodies{};
+
+    // Every rule is known before the bodies refer to them
+    uint32_t line_number = 0;
+    std::size_t line_begin = 0;
+    while (line_begin < text.length()) {
+        std::size_t line_end = text.find('\n', line_begin);
+        if (line_end == std::string_view::npos)
+            line_end = text.length();
+        std::string_view line = text.substr(line_begin, line_end - line_begin);
+        line_begin = line_end + 1;
+        line_number++;
+
+        const std::size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string_view::npos || line[first] == '#')
+            continue;
+        line = line.substr(first, line.find_last_not_of(" \t\r") - first + 1);
+
+        const std::size_t arrow = line.find("->");
+        std::string_view name = line.substr(0, arrow == std::string_view::npos ? 0 : arrow);
+        name = name.substr(0, name.find_last_not_of(" \t") + 1);
+        if (name.empty() || !std::isupper(static_cast<unsigned char>(name.front()))
+            || name.find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_") != std::string_view::npos)
+            fail(grammar, line_number, "expected Name -> body");
+        if (grammar.rule_ids.count(name) != 0)
+            fail(grammar, line_number, "rule " + std::string(name) + " is defined twice");
+
+        const uint32_t id = add_rule(grammar, std::string(name), true, line_number);
+        grammar.rules[id].body = collapse_blanks(line.substr(arrow + 2));
+        grammar.rule_ids.emplace(std::string(name), id);
+        bodies.push_back({id, Line{line_number, line.substr(arrow + 2)}});
+    }
+
+    if (grammar.rules.empty())
+        fail(grammar, line_number, "no rules");
+
+    for (const auto &[id, line] : bodies)
+        BodyParser(grammar, id, line.number, line.body).parse();
+    return grammar;
+}
+
+// FIRST of a sequence, whether all of it can match nothing goes to nullable
+TokenSet first_of(const Grammar &grammar, const Sequence &sequence, std::size_t from, bool &nullable)
+{
+    TokenSet first = 0;
+    for (; from < sequence.size(); from++) {
+        const Symbol symbol = sequence[from];
+        if (symbol.is_terminal) {
+            nullable = false;
+            return first | bit(static_cast<Token::Type>(symbol.id));
+        }
+        first |= grammar.rules[symbol.id].first;
+        if (!grammar.rules[symbol.id].nullable) {
+            nullable = false;
+            return first;
+        }
+    }
+    nullable = true;
+    return first;
+}
+
+// Fixed points of nullable, FIRST and FOLLOW. The first rule is the start one, the tokens end after it
+void compute_sets(Grammar &grammar)
+{
+    grammar.rules.front().follow = bit(Token::Type::NONE);
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (Rule &rule : grammar.rules) {
+            for (const Sequence &alternative : rule.alternatives) {
+                bool nullable = false;
+                const TokenSet first = rule.first | first_of(grammar, alternative, 0, nullable);
+                changed |= first != rule.first || (nullable && !rule.nullable);
+                rule.first = first;
+                rule.nullable |= nullable;
+            }
+        }
+    }
+
+    changed = true;
+    while (changed) {
+        changed = false;
+        for (const Rule &rule : grammar.rules) {
+            for (const Sequence &alternative : rule.alternatives) {
+                for (std::size_t i = 0; i < alternative.size(); i++) {
+                    if (alternative[i].is_terminal)
+                        continue;
+                    bool rest_nullable = false;
+                    TokenSet follow = first_of(grammar, alternative, i + 1, rest_nullable);
+                    if (rest_nullable)
+                        follow |= rule.follow;
+
+                    Rule &target = grammar.rules[alternative[i].id];
+                    changed |= (target.follow | follow) != target.follow;
+                    target.follow |= follow;
+                }
+            }
+        }
+    }
+}
+
+std::string token_names(TokenSet set)
+{
+    std::string names{};
+    for (const auto &[type, name] : magic_enum::enum_entries<Token::Type>()) {
+        if ((set & bit(type)) == 0)
+            continue;
+        names += names.empty() ? "" : " ";
+        names += type == Token::Type::NONE ? std::string_view("end") : name;
+    }
+    return names;
+}
+
+// Alternatives of a rule are told apart by the next token if no token predicts two of them.
+// An alternative is predicted by its FIRST, and by the FOLLOW of the rule if it can match nothing
+bool report_conflicts(const Grammar &grammar)
+{
+    bool is_ll1 = true;
+    for (const Rule &rule : grammar.rules) {
+        std::vector<TokenSet> predicts{};
+        for (const Sequence &alternative : rule.alternatives) {
+            bool nullable = false;
+            TokenSet predict = first_of(grammar, alternative, 0, nullable);
+            if (nullable)
+                predict |= rule.follow;
+            predicts.push_back(predict);
+        }
+
+        for (std::size_t i = 0; i < predicts.size(); i++) {
+            for (std::size_t j = i + 1; j < predicts.size(); j++) {
+                if ((predicts[i] & predicts[j]) == 0)
+                    continue;
+                std::cerr << grammar.file_name << ":" << rule.line << ": LL(1) conflict in " << rule.name
+                    << ", alternatives " << i + 1 << " and " << j + 1 << " both start with "
+                    << token_names(predicts[i] & predicts[j]) << std::endl;
+                is_ll1 = false;
+            }
+        }
+    }
+    return is_ll1;
+}
+
+// Operators of the expression rules. Every level is a rule the one above it starts with, from
+// Expression on, higher levels bind tighter. A level is one of
+//   Next (Operator Next)*    left associative
+//   Next (Operator Self)?    right associative
+//   (Operator Self) | Next   prefix
+// with Operator a terminal or a choice of terminals, e.g. ('+' | '-'). The levels end at the
+// first rule of another shape, the operands
+struct Precedence {
+    // 0 for tokens that are no binary operator
+    std::array<uint8_t, 64> infix_levels{};
+    TokenSet right_associative = 0;
+    TokenSet prefix = 0;
+    uint8_t prefix_level = 0;
+};
+
+std::optional<TokenSet> operator_tokens(const Grammar &grammar, const Symbol symbol)
+{
+    if (symbol.is_terminal)
+        return bit(static_cast<Token::Type>(symbol.id));
+
+    TokenSet tokens = 0;
+    for (const Sequence &alternative : grammar.rules[symbol.id].alternatives) {
+        if (alternative.size() != 1 || !alternative.front().is_terminal)
+            return std::nullopt;
+        tokens |= bit(static_cast<Token::Type>(alternative.front().id));
+    }
+    return tokens;
+}
+
+bool is_rule(const Symbol symbol, const uint32_t rule_id)
+{
+    return !symbol.is_terminal && symbol.id == rule_id;
+}
+
+Precedence read_precedence(const Grammar &grammar)
+{
+    const auto expression = grammar.rule_ids.find("Expression");
+    if (expression == grammar.rule_ids.end())
+        fail(grammar, 1, "no Expression rule to take the operator precedence from");
+
+    Precedence precedence{};
+    uint32_t rule_id = expression->second;
+    for (uint8_t level = 1; level < UINT8_MAX; level++) {
+        const std::vector<Sequence> &alternatives = grammar.rules[rule_id].alternatives;
+
+        // Next Tail, where Tail -> Operator Next Tail | nothing or Tail -> Operator Self | nothing
+        if (alternatives.size() == 1 && alternatives[0].size() == 2
+            && !alternatives[0][0].is_terminal && !alternatives[0][1].is_terminal) {
+            const uint32_t next = alternatives[0][0].id;
+            const uint32_t tail = alternatives[0][1].id;
+            const std::vector<Sequence> &tail_alternatives = grammar.rules[tail].alternatives;
+            if (tail_alternatives.size() == 2 && tail_alternatives[1].empty() && tail_alternatives[0].size() >= 2) {
+                const Sequence &repeated = tail_alternatives[0];
+                const bool left = repeated.size() == 3 && is_rule(repeated[1], next) && is_rule(repeated[2], tail);
+                const bool right = repeated.size() == 2 && is_rule(repeated[1], rule_id);
+                const std::optional<TokenSet> operators = operator_tokens(grammar, repeated[0]);
+                if (operators.has_value() && (left || right)) {
+                    for (std::size_t type = 0; type < precedence.infix_levels.size(); type++) {
+                        if ((operators.value() & (TokenSet{1} << type)) != 0)
+                            precedence.infix_levels[type] = level;
+                    }
+                    if (right)
+                        precedence.right_associative |= operators.value();
+                    rule_id = next;
+                    continue;
+                }
+            }
+        }
+
+        // (Operator Self) | Next
+        if (precedence.prefix == 0 && alternatives.size() == 2 && alternatives[0].size() == 2
+            && is_rule(alternatives[0][1], rule_id) && alternatives[1].size() == 1 && !alternatives[1][0].is_terminal) {
+            if (const std::optional<TokenSet> operators = operator_tokens(grammar, alternatives[0][0])) {
+                precedence.prefix = operators.value();
+                precedence.prefix_level = level;
+                rule_id = alternatives[1][0].id;
+                continue;
+            }
+        }
+        break;
+    }
+    return precedence;
+}
+
+// GlobalStatement -> GLOBAL_STATEMENT
+std::string to_enumerator(std::string_view name)
+{
+    std::string enumerator{};
+    for (std::size_t i = 0; i < name.length(); i++) {
+        if (i > 0 && std::isupper(static_cast<unsigned char>(name[i])))
+            enumerator += '_';
+        enumerator += static_cast<char>(std::toupper(static_cast<unsigned char>(name[i])));
+    }
+    return enumerator;
+}
+
+std::string token_set_expression(TokenSet set)
+{
+    std::string expression{};
+    for (const auto &[type, name] : magic_enum::enum_entries<Token::Type>()) {
+        if ((set & bit(type)) == 0)
+            continue;
+        expression += expression.empty() ? "" : " | ";
+        expression += "bit(Token::Type::" + std::string(name) + ")";
+    }
+    return expression.empty() ? "0" : expression;
+}
+
+void write_header(const Grammar &grammar, const Precedence &precedence, std::ostream &out)
+{
+    out << "// Generated by parsergen from " << grammar.file_name << ", do not edit" << std::endl
+        << "#pragma once" << std::endl << std::endl
+        << "#include <cstdint>" << std::endl
+        << "#include <cstddef>" << std::endl
+        << "#include <string_view>" << std::endl << std::endl
+        << "#include \"Token.h\"" << std::endl << std::endl
+        << "namespace grammar {" << std::endl << std::endl;
+
+    out << "enum class Rule : uint8_t {" << std::endl;
+    for (const Rule &rule : grammar.rules) {
+        if (rule.is_named)
+            out << "    " << to_enumerator(rule.name) << "," << std::endl;
+    }
+    out << "};" << std::endl << std::endl;
+
+    out << "constexpr uint64_t bit(const Token::Type type) { return uint64_t{1} << static_cast<unsigned>(type); }"
+        << std::endl << std::endl;
+
+    out << "// Token types every rule can start with" << std::endl
+        << "constexpr uint64_t FIRST[] = {" << std::endl;
+    for (const Rule &rule : grammar.rules) {
+        if (rule.is_named)
+            out << "    " << token_set_expression(rule.first) << ", // " << rule.name << std::endl;
+    }
+    out << "};" << std::endl << std::endl;
+
+    out << "// Body of every rule as written in the grammar, blanks collapsed. The parse functions are" << std::endl
+        << "// checked against these, a rule changed in the grammar fails the build until they are changed too" << std::endl
+        << "constexpr std::string_view BODIES[] = {" << std::endl;
+    for (const Rule &rule : grammar.rules) {
+        if (!rule.is_named)
+            continue;
+        std::string escaped{};
+        for (const char ch : rule.body) {
+            if (ch == '"' || ch == '\\')
+                escaped += '\\';
+            escaped += ch;
+        }
+        out << "    \"" << escaped << "\", // " << rule.name << std::endl;
+    }
+    out << "};" << std::endl << std::endl;
+
+    out << "// The grammar is LL(1): of the rules that may come next, only one starts with the next token" << std::endl
+        << "constexpr bool starts(const Rule rule, const Token::Type type)" << std::endl
+        << "{" << std::endl
+        << "    return (FIRST[static_cast<std::size_t>(rule)] & bit(type)) != 0;" << std::endl
+        << "}" << std::endl << std::endl;
+
+    out << "// Level of every binary operator of the expression rules, higher binds tighter, 0 for other tokens"
+        << std::endl
+        << "constexpr uint8_t infix_level(const Token::Type type)" << std::endl
+        << "{" << std::endl
+        << "    switch (type) {" << std::endl;
+    for (const auto &[type, name] : magic_enum::enum_entries<Token::Type>()) {
+        const uint8_t level = precedence.infix_levels[static_cast<std::size_t>(type)];
+        if (level != 0)
+            out << "    case Token::Type::" << name << ":" << std::endl
+                << "        return " << static_cast<unsigned>(level) << ";" << std::endl;
+    }
+    out << "    default:" << std::endl
+        << "        return 0;" << std::endl
+        << "    }" << std::endl
+        << "}" << std::endl << std::endl;
+
+    out << "constexpr uint64_t RIGHT_ASSOCIATIVE = " << token_set_expression(precedence.right_associative) << ";"
+        << std::endl << std::endl
+        << "// Prefix operators all bind at one level" << std::endl
+        << "constexpr uint64_t PREFIX_OPERATORS = " << token_set_expression(precedence.prefix) << ";" << std::endl
+        << "constexpr uint8_t PREFIX_LEVEL = " << static_cast<unsigned>(precedence.prefix_level) << ";"
+        << std::endl << std::endl
+        << "} // namespace grammar" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        std::cerr << "Usage: parsergen <grammar_file> <header_file>" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::optional<SourceFile> grammar_file = SourceFile::open(argv[1]);
+    if (!grammar_file.has_value()) {
+        std::cerr << "Can not read " << argv[1] << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    Grammar grammar = read_grammar(argv[1], grammar_file.value().get_text());
+    compute_sets(grammar);
+    if (!report_conflicts(grammar))
+        exit(EXIT_FAILURE);
+
+    std::ofstream out_file{argv[2]};
+    write_header(grammar, read_precedence(grammar), out_file);
+    if (!out_file) {
+        std::cerr << "Can not write " << argv[2] << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
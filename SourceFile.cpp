@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <utility>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SourceFile.h"
+
+std::optional<SourceFile> SourceFile::open(const std::filesystem::path &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return std::optional<SourceFile>();
+
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) != 0) {
+        ::close(fd);
+        return std::optional<SourceFile>();
+    }
+
+    SourceFile source{};
+    bool is_regular = S_ISREG(file_stat.st_mode);
+    std::size_t size = is_regular ? static_cast<std::size_t>(file_stat.st_size) : 0;
+
+    bool loaded = (is_regular && size >= MMAP_THRESHOLD && source.map_fd(fd, size))
+        || source.read_fd(fd, size);
+    ::close(fd); // A mapping stays valid after its descriptor is closed
+
+    if (!loaded)
+        return std::optional<SourceFile>();
+
+    return source;
+}
+
+bool SourceFile::map_fd(const int fd, const std::size_t size)
+{
+    void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+        return false;
+
+    // The lexer walks the file once from start to end
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    mapped_data = static_cast<const char *>(data);
+    mapped_size = size;
+    return true;
+}
+
+bool SourceFile::read_fd(const int fd, const std::size_t size_hint)
+{
+    // Regular files come in one read, pipes until EOF in large chunks
+    std::size_t chunk = std::max<std::size_t>(size_hint, MMAP_THRESHOLD);
+    std::size_t filled = 0;
+
+    while (true) {
+        buffer.resize(filled + chunk);
+        ssize_t n = 0;
+        do {
+            n = ::read(fd, buffer.data() + filled, chunk);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) {
+            buffer.clear();
+            return false;
+        }
+        if (n == 0)
+            break;
+        filled += static_cast<std::size_t>(n);
+    }
+
+    buffer.resize(filled);
+    return true;
+}
+
+SourceFile::SourceFile(SourceFile &&other) noexcept
+    : mapped_data(std::exchange(other.mapped_data, nullptr)),
+      mapped_size(std::exchange(other.mapped_size, 0)),
+      buffer(std::move(other.buffer))
+{
+}
+
+SourceFile &SourceFile::operator=(SourceFile &&other) noexcept
+{
+    if (this != &other) {
+        if (mapped_data)
+            munmap(const_cast<char *>(mapped_data), mapped_size);
+
+        mapped_data = std::exchange(other.mapped_data, nullptr);
+        mapped_size = std::exchange(other.mapped_size, 0);
+        buffer = std::move(other.buffer);
+    }
+    return *this;
+}
+
+SourceFile::~SourceFile()
+{
+    if (mapped_data)
+        munmap(const_cast<char *>(mapped_data), mapped_size);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <optional>
+#include <filesystem>
+
+// Read-only view of an input file. Regular files are memory-mapped, small files
+// and non-regular ones (pipes, terminals) are read into a private buffer at once.
+class SourceFile {
+    const char *mapped_data = nullptr;
+    std::size_t mapped_size = 0;
+    std::string buffer;
+
+    SourceFile() = default;
+
+    bool map_fd(const int fd, const std::size_t size);
+    bool read_fd(const int fd, const std::size_t size_hint);
+
+public:
+    // Smaller files are cheaper to read than to map
+    static constexpr std::size_t MMAP_THRESHOLD = 64 * 1024;
+
+    // Returns no value if the file can not be opened or read
+    static std::optional<SourceFile> open(const std::filesystem::path &path);
+
+    SourceFile(const SourceFile &) = delete;
+    SourceFile &operator=(const SourceFile &) = delete;
+    SourceFile(SourceFile &&other) noexcept;
+    SourceFile &operator=(SourceFile &&other) noexcept;
+    ~SourceFile();
+
+    std::string_view get_text() const {
+        return mapped_data ? std::string_view(mapped_data, mapped_size) : std::string_view(buffer);
+    }
+
+    bool is_mapped() const { return mapped_data != nullptr; }
+};
@@ -0,0 +1,143 @@
+#include <cerrno>
+#include <algorithm>
+
+#include <unistd.h>
+
+#include "StreamingLexer.h"
+#include "Lexer.h"
+#include "Utf8.h"
+
+SourceLocation StreamingLexer::locate(const std::size_t at) const
+{
+    const std::string_view before = std::string_view(window).substr(0, at);
+    const std::size_t last_newline = before.rfind('\n');
+    const uint64_t line_start = last_newline == std::string_view::npos ? line_start_offset : window_offset + last_newline + 1;
+    const uint64_t lines = lines_before_window + static_cast<uint64_t>(std::count(before.begin(), before.end(), '\n'));
+    return SourceLocation{static_cast<uint32_t>(lines + 1), static_cast<uint32_t>(window_offset + at - line_start + 1)};
+}
+
+void StreamingLexer::validate_window(const bool at_end)
+{
+    const utf8::Validation validation = utf8::validate(std::string_view(window).substr(validated_pos));
+    if (validation.valid) {
+        validated_pos = window.size();
+        return;
+    }
+    const std::size_t error_pos = validated_pos + validation.error_offset;
+
+    // The start of a sequence the next chunk goes on with
+    const std::size_t sequence_length = utf8::sequence_length(static_cast<unsigned char>(window[error_pos]));
+    const bool may_be_cut = sequence_length > 1 && error_pos + sequence_length > window.size()
+        && std::all_of(window.begin() + static_cast<std::ptrdiff_t>(error_pos) + 1, window.end(),
+                       [](const char ch) { return (static_cast<unsigned char>(ch) & 0xC0) == 0x80; });
+    if (!at_end && may_be_cut) {
+        validated_pos = error_pos;
+        return;
+    }
+
+    // The input ends before the ill-formed sequence
+    invalid_utf8_offset = window_offset + error_pos;
+    invalid_utf8_location = locate(error_pos);
+    window.resize(error_pos);
+    validated_pos = error_pos;
+    is_eof = true;
+}
+
+bool StreamingLexer::refill()
+{
+    if (is_eof)
+        return false;
+
+    // Lines are counted as the input is dropped, for the location of an unknown symbol. A sequence
+    // not validated yet is kept even if a comment went over it
+    const std::size_t dropped = std::min(window_pos, validated_pos);
+    const auto dropped_end = window.begin() + static_cast<std::ptrdiff_t>(dropped);
+    lines_before_window += static_cast<uint64_t>(std::count(window.begin(), dropped_end, '\n'));
+    const std::size_t last_newline = std::string_view(window).substr(0, dropped).rfind('\n');
+    if (last_newline != std::string_view::npos)
+        line_start_offset = window_offset + last_newline + 1;
+
+    window.erase(0, dropped);
+    window_offset += dropped;
+    window_pos -= dropped;
+    validated_pos -= dropped;
+
+    std::size_t filled = window.size();
+    window.resize(filled + chunk_size);
+
+    ssize_t n = 0;
+    do {
+        n = ::read(fd, window.data() + filled, chunk_size);
+    } while (n < 0 && errno == EINTR);
+
+    if (n <= 0) {
+        // A failed read ends the input as well, but is not taken for its end
+        if (n < 0)
+            read_error = errno;
+        window.resize(filled);
+        is_eof = true;
+        validate_window(true);
+        return false;
+    }
+
+    window.resize(filled + static_cast<std::size_t>(n));
+    validate_window(false);
+    return !is_eof || window_pos < window.size();
+}
+
+std::optional<StreamingLexer::StreamToken> StreamingLexer::next()
+{
+    while (true) {
+        // A comment may go on for several chunks, they are dropped as they come
+        if (in_comment) {
+            std::size_t comment_end = Lexer::skip_comment(window, window_pos);
+            if (comment_end == std::string_view::npos) {
+                window_pos = window.size();
+                if (!refill())
+                    return std::optional<StreamToken>();
+                continue;
+            }
+            window_pos = comment_end;
+            in_comment = false;
+        }
+
+        window_pos = Lexer::skip_blanks(window, window_pos);
+        if (window_pos >= window.size()) {
+            if (!refill())
+                return std::optional<StreamToken>();
+            continue;
+        }
+
+        if (window[window_pos] == '#') {
+            in_comment = true;
+            continue;
+        }
+
+        // The token may go on in the next chunk, lex it again once that is read
+        bool reached_end = false;
+        Token token = Lexer::scan_unicode(window, window_pos, &reached_end);
+        if (reached_end && refill())
+            continue;
+        // Cut at an ill-formed sequence, scanned again without it
+        if (reached_end && (window_pos >= window.size() || window_pos + token.length > window.size()))
+            continue;
+
+        if (token.type == Token::Type::NONE) {
+            stop_location = locate(window_pos);
+
+            // The whole code point, not its first byte
+            const std::size_t symbol_length = std::max<std::size_t>(1,
+                utf8::sequence_length(static_cast<unsigned char>(window[window_pos])));
+            stop_symbol = window.substr(window_pos, symbol_length);
+            return std::optional<StreamToken>();
+        }
+        if (window_offset + window_pos + token.length > Token::MAX_SOURCE_SIZE) {
+            too_long = true;
+            return std::optional<StreamToken>();
+        }
+
+        StreamToken result{token.type, window_offset + window_pos, std::string_view(window).substr(window_pos, token.length)};
+        window_pos += token.length;
+        return result;
+    }
+}
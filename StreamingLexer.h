@@ -0,0 +1,104 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <optional>
+#include <iterator>
+#include <cstdint>
+
+#include "Token.h"
+#include "LineIndex.h"
+
+// Lexes input from a file descriptor chunk by chunk, e.g. a pipe from a code generator.
+// Only the unconsumed tail of the input is kept, tokens and comments may straddle chunks.
+class StreamingLexer {
+    int fd;
+    std::size_t chunk_size;
+
+    std::string window;
+    std::size_t window_pos = 0;
+    uint64_t window_offset = 0; // Offset of window[0] in the whole input
+    // Lines that end before window[0], and the offset where the last of them ends
+    uint64_t lines_before_window = 0;
+    uint64_t line_start_offset = 0;
+    bool is_eof = false;
+    bool in_comment = false;
+    int read_error = 0;
+    bool too_long = false;
+    std::optional<SourceLocation> stop_location;
+    std::string stop_symbol;
+
+    // window is valid UTF-8 up to validated_pos, past it only the start of a sequence cut by the chunk end
+    std::size_t validated_pos = 0;
+    std::optional<uint64_t> invalid_utf8_offset;
+    SourceLocation invalid_utf8_location{};
+
+    // Line and column of window[at] in the whole input
+    SourceLocation locate(const std::size_t at) const;
+
+    // Validates the window from validated_pos on. An ill-formed sequence ends the input before it
+    void validate_window(const bool at_end);
+
+    // Drops the consumed part of the window and appends a chunk. Returns false at end of input
+    bool refill();
+
+public:
+    struct StreamToken {
+        Token::Type type;
+        uint64_t offset;
+        std::string_view value; // Valid until the next token is requested
+    };
+
+    static constexpr std::size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+    explicit StreamingLexer(const int input_fd, const std::size_t chunk = DEFAULT_CHUNK_SIZE)
+        : fd(input_fd), chunk_size(chunk) {}
+
+    // Non-pure, reads more input when needed. Returns no value at the end of input, when
+    // reading failed or at an unknown symbol, see the getters below
+    std::optional<StreamToken> next();
+
+    // errno of the read that failed, 0 if the input was read to its end
+    int get_read_error() const { return read_error; }
+
+    // Lexing stopped before the end of the input at a symbol no token starts with,
+    // get_stop_location() and get_stop_symbol() tell where and which
+    bool stopped_early() const { return stop_location.has_value(); }
+    SourceLocation get_stop_location() const { return stop_location.value(); }
+    std::string_view get_stop_symbol() const { return stop_symbol; }
+
+    // Offset of the first byte of the input that is not valid UTF-8, lexing stopped before it
+    std::optional<uint64_t> get_invalid_utf8_offset() const { return invalid_utf8_offset; }
+    SourceLocation get_invalid_utf8_location() const { return invalid_utf8_location; }
+
+    // Lexing stopped at a token ending past Token::MAX_SOURCE_SIZE bytes, like a source file
+    // that long would be refused
+    bool is_too_long() const { return too_long; }
+
+    class iterator {
+        StreamingLexer *lexer = nullptr;
+        std::optional<StreamToken> current;
+
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = StreamToken;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+        explicit iterator(StreamingLexer *l) : lexer(l), current(l->next()) {}
+
+        const StreamToken &operator*() const { return current.value(); }
+        const StreamToken *operator->() const { return &current.value(); }
+
+        iterator &operator++() {
+            current = lexer->next();
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+
+        bool operator==(std::default_sentinel_t) const { return !current.has_value(); }
+    };
+
+    iterator begin() { return iterator(this); }
+    std::default_sentinel_t end() { return std::default_sentinel; }
+};
@@ -0,0 +1,102 @@
+#include <algorithm>
+
+#include "ThreadPool.h"
+
+namespace {
+// Index of the pool worker running on this thread, npos elsewhere
+thread_local std::size_t current_worker = static_cast<std::size_t>(-1);
+}
+
+ThreadPool::ThreadPool(unsigned int threads_num)
+{
+    threads_num = std::max(1u, threads_num);
+    for (unsigned int i = 0; i < threads_num; i++)
+        queues.push_back(std::make_unique<Queue>());
+    for (unsigned int i = 0; i < threads_num; i++)
+        workers.emplace_back([this, i] { work(i); });
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock{state_mutex};
+        stopping = true;
+    }
+    work_available.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> job)
+{
+    std::size_t target = current_worker;
+    if (target >= queues.size())
+        target = next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+
+    {
+        // Counted before any worker can pop it
+        std::lock_guard<std::mutex> state_lock{state_mutex};
+        std::lock_guard<std::mutex> queue_lock{queues[target]->mutex};
+        queues[target]->jobs.push_back(std::move(job));
+        queued++;
+        pending++;
+    }
+    work_available.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock{state_mutex};
+    all_done.wait(lock, [this] { return pending == 0; });
+}
+
+bool ThreadPool::try_pop(std::size_t worker, std::function<void()> &job)
+{
+    {
+        Queue &own = *queues[worker];
+        std::lock_guard<std::mutex> lock{own.mutex};
+        if (!own.jobs.empty()) {
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            return true;
+        }
+    }
+
+    for (std::size_t i = 1; i < queues.size(); i++) {
+        Queue &victim = *queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> lock{victim.mutex};
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::work(std::size_t worker)
+{
+    current_worker = worker;
+
+    std::function<void()> job;
+    while (true) {
+        if (try_pop(worker, job)) {
+            {
+                std::lock_guard<std::mutex> lock{state_mutex};
+                queued--;
+            }
+            job();
+            job = nullptr;
+
+            std::lock_guard<std::mutex> lock{state_mutex};
+            if (--pending == 0)
+                all_done.notify_all();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock{state_mutex};
+        work_available.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0)
+            return;
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of workers with a job deque each. A worker takes the newest job of its own deque
+// and, once that runs dry, steals the oldest one of another worker. Jobs submitted from a
+// worker go to its own deque, others are spread round robin.
+class ThreadPool {
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex state_mutex;
+    std::condition_variable work_available;
+    std::condition_variable all_done;
+    // Jobs sitting in a deque, and jobs not finished yet
+    std::size_t queued = 0;
+    std::size_t pending = 0;
+    bool stopping = false;
+
+    std::atomic<std::size_t> next_queue{0};
+
+    bool try_pop(std::size_t worker, std::function<void()> &job);
+    void work(std::size_t worker);
+
+public:
+    explicit ThreadPool(unsigned int threads_num);
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    // Runs the jobs left before joining
+    ~ThreadPool();
+
+    // Jobs must not throw
+    void submit(std::function<void()> job);
+
+    // Blocks until every submitted job has finished
+    void wait();
+
+    std::size_t get_threads_num() const { return workers.size(); }
+};
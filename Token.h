@@ -0,0 +1,193 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+#include <memory_resource>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+#include "NumericLiteral.h"
+
+struct Token {
+    enum class Type : uint8_t {
+        NONE,
+        ID,
+        PROC,
+        LPAREN,
+        RPAREN,
+        SEMICOLON,
+        COMMA,
+        COLON,
+        LEFTARROW, // <-
+        RIGHTARROW, // ->
+        BASIC_TYPE, // u8, u32, nil
+        LCURLY,
+        RCURLY,
+        RETURN,
+        ASTERISK,
+        SLASH, // /
+        PLUS,
+        MINUS,
+        STATICVAR,
+        ASSIGN, // :=
+        EQUAL, // =
+        TILDA,
+        NUMERIC_LITERAL,
+    };
+
+    // Offsets and lengths are 32-bit, longer sources are refused before lexing
+    static constexpr std::size_t MAX_SOURCE_SIZE = UINT32_MAX;
+
+    // The lexeme is not owned, it lives in the source buffer the token was lexed from
+    uint32_t offset;
+    uint32_t length;
+    // Symbol id of an ID token, see Interner. For a NUMERIC_LITERAL the index
+    // of its decoded value in TokenStream::literals
+    uint32_t payload;
+    Type type;
+
+    Token(const Type t=Type::NONE, const uint32_t off=0, const uint32_t len=0, const uint32_t pl=0)
+        : offset(off), length(len), payload(pl), type(t) {}
+
+    std::string_view value_in(std::string_view source) const {
+        return source.substr(offset, length);
+    }
+};
+
+static_assert(std::is_trivially_copyable_v<Token>);
+static_assert(sizeof(Token) <= 16);
+
+// Structure of arrays: the parser mostly looks at types, they are packed one byte per token
+class TokenStream {
+    std::pmr::vector<uint8_t> types;
+    std::pmr::vector<uint32_t> offsets;
+    std::pmr::vector<uint32_t> lengths;
+    std::pmr::vector<uint32_t> payloads;
+
+public:
+    // Decoded NUMERIC_LITERAL values, tokens refer to them by payload
+    std::pmr::vector<NumericLiteral> literals;
+
+    // memory is usually the session Arena, the tokens are then freed along with it
+    explicit TokenStream(std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+        : types(memory), offsets(memory), lengths(memory), payloads(memory), literals(memory) {}
+
+    uint32_t add_literal(const NumericLiteral &literal) {
+        literals.push_back(literal);
+        return static_cast<uint32_t>(literals.size() - 1);
+    }
+
+    void push_back(const Token &token) {
+        types.push_back(static_cast<uint8_t>(token.type));
+        offsets.push_back(token.offset);
+        lengths.push_back(token.length);
+        payloads.push_back(token.payload);
+    }
+
+    void reserve(const std::size_t n) {
+        types.reserve(n);
+        offsets.reserve(n);
+        lengths.reserve(n);
+        payloads.reserve(n);
+    }
+
+    void clear() {
+        types.clear();
+        offsets.clear();
+        lengths.clear();
+        payloads.clear();
+        literals.clear();
+    }
+
+    std::size_t size() const { return types.size(); }
+    bool empty() const { return types.empty(); }
+
+    Token::Type type_at(const std::size_t i) const { return static_cast<Token::Type>(types[i]); }
+    uint32_t offset_at(const std::size_t i) const { return offsets[i]; }
+    uint32_t length_at(const std::size_t i) const { return lengths[i]; }
+    uint32_t payload_at(const std::size_t i) const { return payloads[i]; }
+
+    void set_payload(const std::size_t i, const uint32_t payload) { payloads[i] = payload; }
+
+    void append(const TokenStream &other) {
+        const std::size_t first = size();
+        const uint32_t literals_base = static_cast<uint32_t>(literals.size());
+
+        types.insert(types.end(), other.types.begin(), other.types.end());
+        offsets.insert(offsets.end(), other.offsets.begin(), other.offsets.end());
+        lengths.insert(lengths.end(), other.lengths.begin(), other.lengths.end());
+        payloads.insert(payloads.end(), other.payloads.begin(), other.payloads.end());
+        literals.insert(literals.end(), other.literals.begin(), other.literals.end());
+
+        for (std::size_t i = first; literals_base != 0 && i < size(); i++) {
+            if (type_at(i) == Token::Type::NUMERIC_LITERAL)
+                payloads[i] += literals_base;
+        }
+    }
+
+    // Replaces tokens [first, last) with replacement and moves the offsets of the tokens
+    // after them by shift
+    void splice(const std::size_t first, const std::size_t last, const TokenStream &replacement, const int64_t shift) {
+        // Literals are in token order, the replaced tokens own a run of them that is replaced
+        // in place, so edits do not pile up literals
+        std::size_t literals_first = literals.size();
+        std::size_t replaced_literals = 0;
+        for (std::size_t i = first; i < size(); i++) {
+            if (type_at(i) != Token::Type::NUMERIC_LITERAL)
+                continue;
+            if (literals_first == literals.size())
+                literals_first = payloads[i];
+            if (i >= last)
+                break;
+            replaced_literals++;
+        }
+        literals.erase(literals.begin() + literals_first, literals.begin() + literals_first + replaced_literals);
+        literals.insert(literals.begin() + literals_first, replacement.literals.begin(), replacement.literals.end());
+        const uint32_t literals_base = static_cast<uint32_t>(literals_first);
+        const int64_t literals_shift = static_cast<int64_t>(replacement.literals.size()) - static_cast<int64_t>(replaced_literals);
+
+        types.erase(types.begin() + first, types.begin() + last);
+        offsets.erase(offsets.begin() + first, offsets.begin() + last);
+        lengths.erase(lengths.begin() + first, lengths.begin() + last);
+        payloads.erase(payloads.begin() + first, payloads.begin() + last);
+
+        types.insert(types.begin() + first, replacement.types.begin(), replacement.types.end());
+        offsets.insert(offsets.begin() + first, replacement.offsets.begin(), replacement.offsets.end());
+        lengths.insert(lengths.begin() + first, replacement.lengths.begin(), replacement.lengths.end());
+        payloads.insert(payloads.begin() + first, replacement.payloads.begin(), replacement.payloads.end());
+
+        const std::size_t replaced_end = first + replacement.size();
+        for (std::size_t i = first; i < replaced_end; i++) {
+            if (type_at(i) == Token::Type::NUMERIC_LITERAL)
+                payloads[i] += literals_base;
+        }
+        for (std::size_t i = replaced_end; (shift != 0 || literals_shift != 0) && i < size(); i++) {
+            offsets[i] = static_cast<uint32_t>(offsets[i] + shift);
+            if (type_at(i) == Token::Type::NUMERIC_LITERAL)
+                payloads[i] = static_cast<uint32_t>(payloads[i] + literals_shift);
+        }
+    }
+
+    // Bulk fill from packed arrays, e.g. a mapped token file. Sources need no alignment,
+    // payloads are zeroed and literals dropped
+    void assign(const void *t, const void *o, const void *l, const std::size_t n) {
+        types.resize(n);
+        offsets.resize(n);
+        lengths.resize(n);
+        payloads.assign(n, 0);
+        literals.clear();
+        std::memcpy(types.data(), t, n * sizeof(uint8_t));
+        std::memcpy(offsets.data(), o, n * sizeof(uint32_t));
+        std::memcpy(lengths.data(), l, n * sizeof(uint32_t));
+    }
+
+    const uint8_t *type_data() const { return types.data(); }
+    const uint32_t *offset_data() const { return offsets.data(); }
+    const uint32_t *length_data() const { return lengths.data(); }
+
+    Token operator[](const std::size_t i) const {
+        return Token(type_at(i), offsets[i], lengths[i], payloads[i]);
+    }
+};
@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cinttypes>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "TokenCache.h"
+#include "TokenFile.h"
+#include "ContentHash.h"
+#include "Lexer.h"
+
+std::filesystem::path TokenCache::default_directory()
+{
+    const char *dir = std::getenv("MOZART_CACHE_DIR");
+    return dir != nullptr && dir[0] != '\0' ? dir : ".mozart-cache";
+}
+
+std::uintmax_t TokenCache::default_size_limit()
+{
+    const char *mebibytes = std::getenv("MOZART_CACHE_SIZE");
+    if (mebibytes == nullptr || mebibytes[0] == '\0')
+        return DEFAULT_SIZE_LIMIT;
+    return std::strtoumax(mebibytes, nullptr, 10) * 1024 * 1024;
+}
+
+std::filesystem::path TokenCache::entry_path(std::string_view source) const
+{
+    const uint64_t versions = (uint64_t{Lexer::VERSION} << 32) | token_file::VERSION;
+    const uint64_t hash = content_hash::xxh64(source, versions);
+
+    // The length guards against the unlikely hash collision a little more
+    char name[64];
+    std::snprintf(name, sizeof(name), "%016llx-%zx.tokens", static_cast<unsigned long long>(hash), source.size());
+    return directory / name;
+}
+
+std::optional<SourceFile> TokenCache::lookup(std::string_view source) const
+{
+    const std::filesystem::path path = entry_path(source);
+    std::optional<SourceFile> entry = SourceFile::open(path);
+    if (!entry.has_value())
+        return std::nullopt;
+
+    // A damaged entry is a miss, it is dropped so the tokens are stored again
+    std::error_code error;
+    if (!token_file::read_header(entry.value().get_text()).has_value()
+        || Lexer::find_binary_error(entry.value().get_text()).has_value()) {
+        entry.reset();
+        std::filesystem::remove(path, error);
+        return std::nullopt;
+    }
+
+    // Recency is the modification time
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+    return entry;
+}
+
+void TokenCache::store(std::string_view source, std::string_view tokens_data) const
+{
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error)
+        return;
+
+    const std::filesystem::path path = entry_path(source);
+    std::filesystem::path temporary_path = path;
+    temporary_path += "." + std::to_string(getpid()) + "."
+        + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+
+    {
+        std::ofstream out_file{temporary_path, std::ios::binary};
+        out_file.write(tokens_data.data(), tokens_data.size());
+        if (!out_file) {
+            out_file.close();
+            std::filesystem::remove(temporary_path, error);
+            return;
+        }
+    }
+    std::filesystem::rename(temporary_path, path, error);
+    if (error)
+        std::filesystem::remove(temporary_path, error);
+}
+
+void TokenCache::trim() const
+{
+    struct Entry {
+        std::filesystem::path path;
+        std::filesystem::file_time_type used;
+        std::uintmax_t size;
+    };
+
+    std::error_code error;
+    std::vector<Entry> entries{};
+    std::uintmax_t total = 0;
+    const std::filesystem::file_time_type stale_time = std::filesystem::file_time_type::clock::now() - STALE_TEMPORARY_AGE;
+    for (const std::filesystem::directory_entry &file : std::filesystem::directory_iterator(directory, error)) {
+        // Left behind by a writer that died before its rename, a live one is done long before
+        if (file.path().extension() == ".tmp") {
+            if (file.is_regular_file(error) && file.last_write_time(error) < stale_time && !error)
+                std::filesystem::remove(file.path(), error);
+            continue;
+        }
+        if (file.path().extension() != ".tokens" || !file.is_regular_file(error))
+            continue;
+        Entry entry{file.path(), file.last_write_time(error), file.file_size(error)};
+        if (error)
+            continue;
+        total += entry.size;
+        entries.push_back(std::move(entry));
+    }
+    if (total <= size_limit)
+        return;
+
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.used < b.used; });
+    for (const Entry &entry : entries) {
+        if (total <= size_limit)
+            break;
+        if (std::filesystem::remove(entry.path, error))
+            total -= entry.size;
+    }
+}
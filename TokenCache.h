@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "SourceFile.h"
+
+// On-disk cache of binary token files, keyed by the xxh64 of the source bytes seeded with the lexer
+// and token file versions. Entries are touched on every hit, trim() evicts the least recently used
+// ones beyond the size limit. Safe to share between threads and processes: entries are written
+// to a temporary file and renamed into place.
+class TokenCache {
+    std::filesystem::path directory;
+    std::uintmax_t size_limit;
+
+    std::filesystem::path entry_path(std::string_view source) const;
+
+public:
+    static constexpr std::uintmax_t DEFAULT_SIZE_LIMIT = 512 * 1024 * 1024;
+
+    // Temporary files this old are taken for ones of crashed writers
+    static constexpr std::chrono::hours STALE_TEMPORARY_AGE{1};
+
+    // $MOZART_CACHE_DIR, .mozart-cache in the working directory otherwise
+    static std::filesystem::path default_directory();
+
+    // $MOZART_CACHE_SIZE in MiB, DEFAULT_SIZE_LIMIT otherwise
+    static std::uintmax_t default_size_limit();
+
+    explicit TokenCache(std::filesystem::path dir = default_directory(),
+                        const std::uintmax_t limit = default_size_limit())
+        : directory(std::move(dir)), size_limit(limit) {}
+
+    // The mapped token file of the source, checked token by token. No value on a miss,
+    // damaged entries are removed and missed
+    std::optional<SourceFile> lookup(std::string_view source) const;
+
+    // tokens_data is the token file of all of source. Failures only cost the entry
+    void store(std::string_view source, std::string_view tokens_data) const;
+
+    // Removes stale temporary files, then the least recently used entries until the cache
+    // fits its size limit
+    void trim() const;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+#include <optional>
+
+// Binary token file, version 1. Host byte order, every section follows the previous one:
+//
+//   TokenFileHeader
+//   uint8_t  types[token_count]      padded with zeros to a multiple of 4
+//   uint32_t offsets[token_count]    into the pool
+//   uint32_t lengths[token_count]
+//   char     pool[pool_size]         token values back to back
+//
+// Sections are laid out so the file can be mapped and read in place.
+namespace token_file {
+
+constexpr char MAGIC[4] = {'M', 'Z', 'T', 'K'};
+constexpr uint32_t VERSION = 1;
+
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint64_t token_count;
+    uint64_t pool_size;
+};
+
+static_assert(sizeof(Header) == 24);
+
+struct Layout {
+    std::size_t types;
+    std::size_t offsets;
+    std::size_t lengths;
+    std::size_t pool;
+    std::size_t total;
+
+    // No value if the sizes overflow, headers come from untrusted files
+    static std::optional<Layout> of(const uint64_t token_count, const uint64_t pool_size) {
+        Layout l{};
+        uint64_t padded_count = 0;
+        uint64_t words_size = 0;
+        l.types = sizeof(Header);
+        if (__builtin_add_overflow(token_count, 3, &padded_count)
+            || __builtin_mul_overflow(token_count, sizeof(uint32_t), &words_size)
+            || __builtin_add_overflow(l.types, padded_count & ~uint64_t{3}, &l.offsets)
+            || __builtin_add_overflow(l.offsets, words_size, &l.lengths)
+            || __builtin_add_overflow(l.lengths, words_size, &l.pool)
+            || __builtin_add_overflow(l.pool, pool_size, &l.total))
+            return std::nullopt;
+        return l;
+    }
+};
+
+// Every token takes more than a byte and the pool is part of the file, larger counts are
+// corrupted. Checked before the layout is computed from them
+inline bool counts_fit(const Header &header, std::string_view data) {
+    return header.token_count <= data.size() && header.pool_size <= data.size();
+}
+
+inline bool has_magic(std::string_view data) {
+    return data.size() >= sizeof(MAGIC) && std::memcmp(data.data(), MAGIC, sizeof(MAGIC)) == 0;
+}
+
+// No value unless data is a complete token file of this version
+inline std::optional<Header> read_header(std::string_view data) {
+    Header header{};
+    if (!has_magic(data) || data.size() < sizeof(header))
+        return std::nullopt;
+    std::memcpy(&header, data.data(), sizeof(header));
+
+    if (header.version != VERSION || !counts_fit(header, data))
+        return std::nullopt;
+    std::optional<Layout> layout = Layout::of(header.token_count, header.pool_size);
+    if (!layout.has_value() || layout.value().total != data.size())
+        return std::nullopt;
+    return header;
+}
+
+} // namespace token_file
@@ -0,0 +1,82 @@
+#include "TokenJsonWriter.h"
+
+#include "magic_enum.hpp"
+
+TokenJsonWriter::TokenJsonWriter(std::ostream &o) : out(o)
+{
+    buffer.reserve(BUFFER_SIZE);
+    buffer += '[';
+}
+
+TokenJsonWriter::~TokenJsonWriter()
+{
+    finish();
+}
+
+void TokenJsonWriter::push(const Token &token, std::string_view value)
+{
+    if (!is_first)
+        buffer += ',';
+    is_first = false;
+
+    buffer += "{\"type\":\"";
+    buffer += magic_enum::enum_name(token.type);
+    buffer += "\",\"value\":\"";
+    write_escaped(value);
+    buffer += "\"}";
+
+    flush_if_full();
+}
+
+void TokenJsonWriter::finish()
+{
+    if (is_finished)
+        return;
+    is_finished = true;
+
+    buffer += ']';
+    out.write(buffer.data(), buffer.size());
+    out.flush();
+    buffer.clear();
+}
+
+// Same escaping as nlohmann::json::dump(), bytes above 0x7f are passed through
+void TokenJsonWriter::write_escaped(std::string_view text)
+{
+    static constexpr char hex_digits[] = "0123456789abcdef";
+
+    std::size_t run_start = 0;
+    for (std::size_t i = 0; i < text.length(); i++) {
+        unsigned char ch = static_cast<unsigned char>(text[i]);
+        if (ch >= 0x20 && ch != '"' && ch != '\\')
+            continue;
+
+        buffer.append(text.substr(run_start, i - run_start));
+        run_start = i + 1;
+
+        switch (ch) {
+        case '"': buffer += "\\\""; break;
+        case '\\': buffer += "\\\\"; break;
+        case '\b': buffer += "\\b"; break;
+        case '\f': buffer += "\\f"; break;
+        case '\n': buffer += "\\n"; break;
+        case '\r': buffer += "\\r"; break;
+        case '\t': buffer += "\\t"; break;
+        default:
+            buffer += "\\u00";
+            buffer += hex_digits[ch >> 4];
+            buffer += hex_digits[ch & 0xf];
+            break;
+        }
+    }
+    buffer.append(text.substr(run_start));
+}
+
+void TokenJsonWriter::flush_if_full()
+{
+    if (buffer.size() < BUFFER_SIZE)
+        return;
+
+    out.write(buffer.data(), buffer.size());
+    buffer.clear();
+}
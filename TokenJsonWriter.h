@@ -0,0 +1,33 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "Token.h"
+
+// Writes the same json as Lexer::serialize_to_json, token by token, through a fixed
+// size buffer. Can be passed to Lexer::tokenize_into as a sink.
+class TokenJsonWriter {
+    std::ostream &out;
+    std::string buffer;
+    bool is_first = true;
+    bool is_finished = false;
+
+    void write_escaped(std::string_view text);
+    void flush_if_full();
+
+public:
+    static constexpr std::size_t BUFFER_SIZE = 64 * 1024;
+
+    explicit TokenJsonWriter(std::ostream &o);
+    ~TokenJsonWriter();
+
+    TokenJsonWriter(const TokenJsonWriter &) = delete;
+    TokenJsonWriter &operator=(const TokenJsonWriter &) = delete;
+
+    void push(const Token &token, std::string_view value);
+
+    // Closes the array and flushes, called by the destructor otherwise
+    void finish();
+};
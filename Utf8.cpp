@@ -0,0 +1,333 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "Utf8.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define UTF8_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace utf8 {
+
+namespace {
+
+struct Range {
+    char32_t first;
+    char32_t last;
+};
+
+constexpr Range xid_start_ranges[] = {
+    {0x0041, 0x005A}, {0x0061, 0x007A}, {0x00AA, 0x00AA}, {0x00B5, 0x00B5}, {0x00BA, 0x00BA},
+    {0x00C0, 0x00D6}, {0x00D8, 0x00F6}, {0x00F8, 0x02C1}, {0x02C6, 0x02D1}, {0x02E0, 0x02E4},
+    {0x0370, 0x0374}, {0x0376, 0x0377}, {0x037B, 0x037D}, {0x037F, 0x037F}, {0x0386, 0x0386},
+    {0x0388, 0x038A}, {0x038C, 0x038C}, {0x038E, 0x03A1}, {0x03A3, 0x03F5}, {0x03F7, 0x0481},
+    {0x048A, 0x052F}, {0x0531, 0x0556}, {0x0561, 0x0587}, {0x05D0, 0x05EA}, {0x0620, 0x064A},
+    {0x0904, 0x0939}, {0x0E01, 0x0E30}, {0x0E32, 0x0E33}, {0x10A0, 0x10C5}, {0x10D0, 0x10FA},
+    {0x1E00, 0x1F15}, {0x3041, 0x3096}, {0x30A1, 0x30FA}, {0x3105, 0x312F}, {0x3400, 0x4DBF},
+    {0x4E00, 0x9FFF}, {0xAC00, 0xD7A3}, {0xF900, 0xFA6D}, {0xFF21, 0xFF3A}, {0xFF41, 0xFF5A},
+    {0x20000, 0x2A6DF},
+};
+
+// Continue only, on top of xid_start_ranges
+constexpr Range xid_continue_ranges[] = {
+    {0x0030, 0x0039}, {0x005F, 0x005F}, {0x00B7, 0x00B7}, {0x0300, 0x036F}, {0x0387, 0x0387},
+    {0x0483, 0x0487}, {0x0591, 0x05BD}, {0x0610, 0x061A}, {0x064B, 0x0669}, {0x093A, 0x094F},
+    {0x0966, 0x096F}, {0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E}, {0x0E50, 0x0E59},
+    {0x203F, 0x2040}, {0x3099, 0x309A}, {0xFF10, 0xFF19},
+};
+
+template <std::size_t N>
+bool in_ranges(const Range (&ranges)[N], const char32_t code_point)
+{
+    const Range *found = std::upper_bound(std::begin(ranges), std::end(ranges), code_point,
+        [](const char32_t cp, const Range &range) { return cp < range.first; });
+    return found != std::begin(ranges) && code_point <= (found - 1)->last;
+}
+
+constexpr bool ranges_are_sorted(const Range *ranges, const std::size_t n)
+{
+    for (std::size_t i = 0; i < n; i++) {
+        if (ranges[i].first > ranges[i].last || (i > 0 && ranges[i - 1].last >= ranges[i].first))
+            return false;
+    }
+    return true;
+}
+
+static_assert(ranges_are_sorted(xid_start_ranges, std::size(xid_start_ranges)));
+static_assert(ranges_are_sorted(xid_continue_ranges, std::size(xid_continue_ranges)));
+
+// Offset of the first ill-formed sequence in [pos, text.length()), the length if there is none
+std::size_t find_error_scalar(std::string_view text, std::size_t pos, bool &ascii)
+{
+    char32_t code_point;
+    while (pos < text.length()) {
+        if (static_cast<unsigned char>(text[pos]) < 0x80) {
+            pos++;
+            continue;
+        }
+        ascii = false;
+        const std::size_t length = decode(text, pos, code_point);
+        if (length == 0)
+            return pos;
+        pos += length;
+    }
+    return pos;
+}
+
+Validation validate_scalar(std::string_view text)
+{
+    bool ascii = true;
+    const std::size_t error_offset = find_error_scalar(text, 0, ascii);
+    return Validation{error_offset == text.length(), ascii, error_offset};
+}
+
+#ifdef UTF8_SIMD_X86
+
+// Only skips ASCII blocks, a block with a high byte is left to the scalar decoder.
+// SSE2 is only the baseline on x86_64, i386 builds need the target attribute
+__attribute__((target("sse2")))
+Validation validate_sse2(std::string_view text)
+{
+    bool ascii = true;
+    std::size_t pos = 0;
+    while (pos < text.length()) {
+        for (; pos + 16 <= text.length(); pos += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text.data() + pos));
+            if (_mm_movemask_epi8(block) != 0)
+                break;
+        }
+        if (pos >= text.length())
+            break;
+
+        // Decode up to the end of the sequences that start in this block
+        const std::size_t block_end = std::min(pos + 16, text.length());
+        char32_t code_point;
+        while (pos < block_end) {
+            if (static_cast<unsigned char>(text[pos]) < 0x80) {
+                pos++;
+                continue;
+            }
+            ascii = false;
+            const std::size_t length = decode(text, pos, code_point);
+            if (length == 0)
+                return Validation{false, false, pos};
+            pos += length;
+        }
+    }
+    return Validation{true, ascii, text.length()};
+}
+
+// Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte". Every byte is
+// classified by three table lookups on nibbles of itself and of the byte before it, the
+// bitwise and of the three is non zero for an error. 3 and 4 byte sequences are checked
+// against the bytes two and three back.
+constexpr uint8_t TOO_SHORT = 1 << 0;
+constexpr uint8_t TOO_LONG = 1 << 1;
+constexpr uint8_t OVERLONG_3 = 1 << 2;
+constexpr uint8_t TOO_LARGE = 1 << 3;
+constexpr uint8_t SURROGATE = 1 << 4;
+constexpr uint8_t OVERLONG_2 = 1 << 5;
+constexpr uint8_t TOO_LARGE_1000 = 1 << 6;
+constexpr uint8_t OVERLONG_4 = 1 << 6;
+constexpr uint8_t TWO_CONTS = 1 << 7;
+constexpr uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+struct Avx2State {
+    __m256i error;
+    __m256i prev_input;
+    __m256i prev_incomplete;
+    bool ascii;
+};
+
+__attribute__((target("avx2")))
+inline __m256i table_avx2(const uint8_t (&t)[16])
+{
+    const __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i *>(t));
+    return _mm256_broadcastsi128_si256(half);
+}
+
+// The 32 bytes ending N bytes before the end of input
+template <int N>
+__attribute__((target("avx2")))
+inline __m256i prev_avx2(const __m256i input, const __m256i prev_input)
+{
+    return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev_input, input, 0x21), 16 - N);
+}
+
+__attribute__((target("avx2")))
+inline __m256i high_nibbles_avx2(const __m256i v)
+{
+    return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+}
+
+__attribute__((target("avx2")))
+void check_block_avx2(Avx2State &state, const __m256i input)
+{
+    // Only an unfinished sequence of the previous block can fail an ASCII block
+    if (_mm256_movemask_epi8(input) == 0) {
+        state.error = _mm256_or_si256(state.error, state.prev_incomplete);
+        state.prev_input = input;
+        state.prev_incomplete = _mm256_setzero_si256();
+        return;
+    }
+    state.ascii = false;
+
+    static constexpr uint8_t byte_1_high[16] = {
+        // 0_______ ________
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        // 10______ ________
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        // 1100____ ________
+        TOO_SHORT | OVERLONG_2,
+        // 1101____ ________
+        TOO_SHORT,
+        // 1110____ ________
+        TOO_SHORT | OVERLONG_3 | SURROGATE,
+        // 1111____ ________
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+    };
+    static constexpr uint8_t byte_1_low[16] = {
+        // ____0000 ________
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+        // ____0001 ________
+        CARRY | OVERLONG_2,
+        // ____001_ ________
+        CARRY, CARRY,
+        // ____0100 ________
+        CARRY | TOO_LARGE,
+        // ____0101 ________ and up
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        // ____1101 ________
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+    };
+    static constexpr uint8_t byte_2_high[16] = {
+        // ________ 0_______
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        // ________ 1000____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+        // ________ 1001____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        // ________ 101_____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        // ________ 11______
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    };
+
+    const __m256i prev1 = prev_avx2<1>(input, state.prev_input);
+    const __m256i special_cases = _mm256_and_si256(
+        _mm256_and_si256(
+            _mm256_shuffle_epi8(table_avx2(byte_1_high), high_nibbles_avx2(prev1)),
+            _mm256_shuffle_epi8(table_avx2(byte_1_low), _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F)))),
+        _mm256_shuffle_epi8(table_avx2(byte_2_high), high_nibbles_avx2(input)));
+
+    // Bytes after a 3 or 4 byte lead must be continuations, the lookups alone can't tell
+    const __m256i prev2 = prev_avx2<2>(input, state.prev_input);
+    const __m256i prev3 = prev_avx2<3>(input, state.prev_input);
+    const __m256i is_third_byte = _mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+    const __m256i is_fourth_byte = _mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+    const __m256i must_be_continuation = _mm256_and_si256(
+        _mm256_or_si256(is_third_byte, is_fourth_byte), _mm256_set1_epi8(static_cast<char>(0x80)));
+
+    state.error = _mm256_or_si256(state.error, _mm256_xor_si256(must_be_continuation, special_cases));
+
+    // A lead byte in the last three bytes needs the next block
+    const __m256i max_value = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+    state.prev_incomplete = _mm256_subs_epu8(input, max_value);
+    state.prev_input = input;
+}
+
+__attribute__((target("avx2")))
+Validation validate_avx2(std::string_view text)
+{
+    Avx2State state{_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256(), true};
+
+    std::size_t pos = 0;
+    for (; pos + 32 <= text.length(); pos += 32)
+        check_block_avx2(state, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text.data() + pos)));
+
+    // The tail is padded with zeros, a sequence cut by the end meets one and fails as too short
+    char tail[32] = {};
+    std::memcpy(tail, text.data() + pos, text.length() - pos);
+    check_block_avx2(state, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(tail)));
+    state.error = _mm256_or_si256(state.error, state.prev_incomplete);
+
+    if (_mm256_testz_si256(state.error, state.error))
+        return Validation{true, state.ascii, text.length()};
+
+    // Errors are rare, the scalar decoder finds where it is
+    return validate_scalar(text);
+}
+
+#endif // UTF8_SIMD_X86
+
+using ValidateFunction = Validation (*)(std::string_view);
+
+ValidateFunction select_validate()
+{
+#ifdef UTF8_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return validate_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return validate_sse2;
+#endif
+    return validate_scalar;
+}
+
+} // namespace
+
+Validation validate(std::string_view text)
+{
+    static const ValidateFunction selected = select_validate();
+    return selected(text);
+}
+
+std::size_t decode(std::string_view text, const std::size_t pos, char32_t &code_point)
+{
+    const unsigned char lead = static_cast<unsigned char>(text[pos]);
+    const std::size_t length = sequence_length(lead);
+    if (length == 0 || pos + length > text.length())
+        return 0;
+    if (length == 1) {
+        code_point = lead;
+        return 1;
+    }
+
+    char32_t cp = lead & (0x7F >> length);
+    for (std::size_t i = 1; i < length; i++) {
+        const unsigned char next = static_cast<unsigned char>(text[pos + i]);
+        if ((next & 0xC0) != 0x80)
+            return 0;
+        cp = (cp << 6) | (next & 0x3F);
+    }
+
+    // Overlong forms, surrogates and values past U+10FFFF
+    static constexpr char32_t min_value[5] = {0, 0, 0x80, 0x800, 0x10000};
+    if (cp < min_value[length] || (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF)
+        return 0;
+
+    code_point = cp;
+    return length;
+}
+
+bool is_xid_start(const char32_t code_point)
+{
+    return in_ranges(xid_start_ranges, code_point);
+}
+
+bool is_xid_continue(const char32_t code_point)
+{
+    return in_ranges(xid_start_ranges, code_point) || in_ranges(xid_continue_ranges, code_point);
+}
+
+} // namespace utf8
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+// UTF-8 validation and decoding for the lexer. Validation is vectorized like LexerSimd:
+// AVX2 checks every byte, SSE2 only skips ASCII blocks, other targets run scalar code.
+namespace utf8 {
+
+struct Validation {
+    bool valid;
+    // No byte above 0x7f, the lexer can stay on its ASCII tables
+    bool ascii;
+    // First byte that is not part of a well-formed sequence, the text length if valid
+    std::size_t error_offset;
+};
+
+Validation validate(std::string_view text);
+
+// Length of the sequence a lead byte starts, 0 for a continuation or an invalid byte
+inline std::size_t sequence_length(const unsigned char lead)
+{
+    if (lead < 0x80)
+        return 1;
+    if (lead < 0xC2)
+        return 0;
+    if (lead < 0xE0)
+        return 2;
+    if (lead < 0xF0)
+        return 3;
+    if (lead < 0xF5)
+        return 4;
+    return 0;
+}
+
+// Decodes the code point at pos into code_point and returns its length, 0 if the sequence is
+// ill-formed or cut by the end of text
+std::size_t decode(std::string_view text, std::size_t pos, char32_t &code_point);
+
+// Abridged XID_Start and XID_Continue: ASCII plus the letters, marks and digits of the
+// common scripts, not the full Unicode tables
+bool is_xid_start(char32_t code_point);
+bool is_xid_continue(char32_t code_point);
+
+} // namespace utf8
@@ -1,47 +1,430 @@
 #include <iostream>
 #include <cstring>
+#include <cstdlib>
+#include <algorithm>
 #include <string>
 #include <filesystem>
 #include <fstream>
+#include <optional>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <iomanip>
+#include <sstream>
+
+#include <unistd.h>
 
 #include "Lexer.h"
 #include "Parser.h"
+#include "Interner.h"
+#include "Arena.h"
+#include "SourceFile.h"
+#include "TokenFile.h"
+#include "TokenJsonWriter.h"
+#include "StreamingLexer.h"
+#include "ThreadPool.h"
+#include "TokenCache.h"
+#include "Utf8.h"
 
 void print_usage() {
     std::cout << "<The Mozart Programming Language Compiler>" << std::endl << std::endl;
     std::cout << "Usage:" << std::endl << std::endl;
-    std::cout << "Tokenize(with lexer) a source file into json:" << std::endl
-        << "mozart t <source_file> [destination_file]" << std::endl << std::endl;
-    std::cout << "Parse(with parser) and construct AST into json:" << std::endl
-        << "mozart p <tokens_json_file> [destination_file]" << std::endl << std::endl;
+    std::cout << "Tokenize(with lexer) a source file into binary tokens, or json with --json:" << std::endl
+        << "mozart t <source_file> [destination_file] [--json] [-j threads_num]" << std::endl
+        << "(use - as source_file to lex stdin as it comes, a destination_file ending in .mz is taken"
+        << std::endl << "as a second source file and makes it a batch)" << std::endl << std::endl;
+    std::cout << "Tokenize many source files, one tokens file next to each or in destination_dir:" << std::endl
+        << "mozart t <source_file>... [@response_file]... [-o destination_dir] [--json] [-j threads_num]" << std::endl
+        << "(a response file lists one source file per line)" << std::endl << std::endl;
+    std::cout << "Tokens of unchanged sources are reused from $MOZART_CACHE_DIR, or .mozart-cache, unless" << std::endl
+        << "--no-cache is given. The least recently used ones go past $MOZART_CACHE_SIZE MiB, 512 by default"
+        << std::endl << std::endl;
+    std::cout << "Parse(with parser) binary or json tokens and construct AST into json:" << std::endl
+        << "mozart p <tokens_file> [destination_file]" << std::endl << std::endl;
+    std::cout << "Compile(lex and parse together) a source file:" << std::endl
+        << "mozart c <source_file>" << std::endl << std::endl;
+}
+
+// Source files are never written over by tokens
+bool is_source_path(const std::filesystem::path &file_path) {
+    return file_path.extension() == ".mz";
+}
+
+std::filesystem::path default_tokens_path(const bool json_output) {
+    return json_output ? "mozart.tokens.json" : "mozart.tokens";
+}
+
+// <source_file>.tokens, or <destination_dir>/<source file name>.tokens
+std::filesystem::path batch_tokens_path(const std::filesystem::path &source_path,
+                                        const std::filesystem::path &output_dir, const bool json_output) {
+    std::filesystem::path destination_path = output_dir.empty() ? source_path : output_dir / source_path.filename();
+    destination_path += json_output ? ".tokens.json" : ".tokens";
+    return destination_path;
+}
+
+// One source file per line, blank lines are skipped
+std::optional<std::vector<std::filesystem::path>> read_response_file(const std::filesystem::path &file_path) {
+    std::ifstream in_file{file_path};
+    if (!in_file)
+        return std::nullopt;
+
+    std::vector<std::filesystem::path> source_paths{};
+    std::string line;
+    while (std::getline(in_file, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (!line.empty())
+            source_paths.push_back(line);
+    }
+    return source_paths;
+}
+
+struct TokenizeReport {
+    std::filesystem::path source_path;
+    std::size_t bytes = 0;
+    std::size_t tokens_num = 0;
+    double milliseconds = 0;
+    bool cached = false;
+    bool failed = false;
+    // Tokens were written, but only up to an unknown symbol
+    bool stopped_early = false;
+    // Errors and diagnostics, batches print them once every file is done
+    std::string messages;
+};
+
+void write_json_tokens(std::ostream &out, const Lexer &lexer) {
+    TokenJsonWriter writer{out};
+    for (std::size_t i = 0; i < lexer.tokens.size(); i++)
+        writer.push(lexer.tokens[i], lexer.get_token_value(lexer.tokens[i]));
+    writer.finish();
+}
+
+// Every file is a session of its own, with its own arena and symbols, so files can be lexed in parallel.
+// cache may be null
+TokenizeReport tokenize_file(const std::filesystem::path &source_path, const std::filesystem::path &destination_path,
+                             const bool json_output, const unsigned int threads_num, const TokenCache *cache) {
+    TokenizeReport report{};
+    report.source_path = source_path;
+    const auto start = std::chrono::steady_clock::now();
+
+    std::optional<SourceFile> source = SourceFile::open(source_path);
+    if (!source.has_value()) {
+        report.failed = true;
+        report.messages = "File <<" + source_path.string() + ">> can't be read!\n";
+        return report;
+    }
+    report.bytes = source.value().get_text().length();
+    if (report.bytes > Token::MAX_SOURCE_SIZE) {
+        report.failed = true;
+        report.messages = "File <<" + source_path.string() + ">> is larger than 4 GiB, it can't be tokenized!\n";
+        return report;
+    }
+
+    std::ofstream out_file{destination_path, json_output ? std::ios::out : std::ios::out | std::ios::binary};
+    if (!out_file) {
+        report.failed = true;
+        report.messages = "File <<" + destination_path.string() + ">> can't be written!\n";
+        return report;
+    }
+
+    Arena arena{};
+    Interner interner{&arena};
+    std::string_view source_text = source.value().get_text();
+
+    // Checked before the cache, tokens cached for a source never vouch for its encoding
+    Lexer lexer(interner, source_text, &arena);
+
+    if (std::optional<std::size_t> invalid_offset = lexer.get_invalid_utf8_offset()) {
+        SourceLocation location = lexer.get_location(invalid_offset.value());
+        report.failed = true;
+        report.messages = source_path.string() + ":" + std::to_string(location.line) + ":"
+            + std::to_string(location.column) + ": not valid UTF-8, the file is not tokenized.\n";
+        out_file.close();
+        std::error_code error;
+        std::filesystem::remove(destination_path, error);
+        return report;
+    }
+
+    // An unchanged source is not lexed again, binary output is a copy of its cached tokens
+    if (cache != nullptr) {
+        if (std::optional<SourceFile> cached = cache->lookup(source_text)) {
+            std::string_view tokens_data = cached.value().get_text();
+            report.tokens_num = token_file::read_header(tokens_data).value().token_count;
+            report.cached = true;
+
+            if (json_output) {
+                Lexer cached_lexer{interner, "", &arena};
+                cached_lexer.load_from_binary(tokens_data);
+                write_json_tokens(out_file, cached_lexer);
+            } else {
+                out_file.write(tokens_data.data(), tokens_data.size());
+            }
+
+            report.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            return report;
+        }
+    }
+
+    // Tokenizing its content straight into the output file. Nothing is kept to fill the cache
+    // with, a json miss stays a miss rather than holding every token
+    if (json_output && threads_num <= 1) {
+        // Tokens only go through the writer
+        struct CountingSink {
+            TokenJsonWriter &writer;
+            std::size_t count = 0;
+            void push(const Token &token, std::string_view value) {
+                writer.push(token, value);
+                count++;
+            }
+        };
+        TokenJsonWriter writer{out_file};
+        CountingSink sink{writer};
+        lexer.tokenize_into(sink);
+        writer.finish();
+        report.tokens_num = sink.count;
+    } else {
+        if (threads_num > 1)
+            lexer.tokenize_parallel(threads_num);
+        else
+            lexer.tokenize();
+        report.tokens_num = lexer.tokens.size();
+
+        if (json_output)
+            write_json_tokens(out_file, lexer);
+
+        // Tokens cut short by an unknown symbol are not cached, its diagnostic has to come up again
+        if (cache != nullptr && lexer.get_pos() == source_text.length()) {
+            std::ostringstream tokens_data{};
+            lexer.serialize_to_binary(tokens_data);
+            if (!json_output)
+                out_file.write(tokens_data.view().data(), tokens_data.view().size());
+            cache->store(source_text, tokens_data.view());
+        } else if (!json_output) {
+            lexer.serialize_to_binary(out_file);
+        }
+    }
+    out_file.close();
+
+    if (lexer.get_pos() < lexer.get_source_text().length()) {
+        report.stopped_early = true;
+        SourceLocation location = lexer.get_location(lexer.get_pos());
+        // The whole code point, not its first byte
+        const std::size_t symbol_length = std::max<std::size_t>(1,
+            utf8::sequence_length(static_cast<unsigned char>(source_text[lexer.get_pos()])));
+        report.messages = source_path.string() + ":" + std::to_string(location.line) + ":"
+            + std::to_string(location.column) + ": unknown symbol <<"
+            + std::string(source_text.substr(lexer.get_pos(), symbol_length)) + ">>, tokens after it are dropped.\n";
+    }
+
+    report.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return report;
+}
+
+// Per file timings in input order, then totals. False if any file failed or stopped early
+bool print_batch_summary(const std::vector<TokenizeReport> &reports, const double seconds) {
+    bool all_lexed = true;
+    std::size_t total_bytes = 0;
+    std::size_t total_tokens = 0;
+    std::size_t failed_num = 0;
+    std::size_t cached_num = 0;
+
+    std::cout << std::fixed << std::setprecision(3);
+    for (const TokenizeReport &report : reports) {
+        std::cerr << report.messages;
+        all_lexed &= !report.stopped_early;
+        if (report.failed) {
+            failed_num++;
+            continue;
+        }
+        total_bytes += report.bytes;
+        total_tokens += report.tokens_num;
+        cached_num += report.cached;
+        std::cout << std::setw(10) << report.milliseconds << " ms " << std::setw(12) << report.bytes << " bytes "
+            << std::setw(10) << report.tokens_num << " tokens " << (report.cached ? "cached " : "       ")
+            << report.source_path.string() << std::endl;
+    }
+
+    const double wall_seconds = std::max(seconds, 1e-9);
+    std::cout << "Tokenized " << reports.size() - failed_num << " of " << reports.size() << " files ("
+        << cached_num << " from cache), "
+        << total_bytes << " bytes, " << total_tokens << " tokens in " << seconds * 1000 << " ms: "
+        << total_bytes / wall_seconds / (1024 * 1024) << " MiB/s, "
+        << total_tokens / wall_seconds / 1e6 << " M tokens/s" << std::endl;
+    return failed_num == 0 && all_lexed;
+}
+
+// source_path:line:column: of the token a parse of the source stopped at
+void print_syntax_error(const std::filesystem::path &source_path, const Lexer &lexer, const uint32_t failure_pos) {
+    std::string_view source_text = lexer.get_source_text();
+    std::size_t offset = source_text.length();
+    std::string message = "syntax error, the file ends too early.";
+    if (failure_pos < lexer.tokens.size()) {
+        offset = lexer.tokens.offset_at(failure_pos);
+        message = "syntax error at <<" + std::string(lexer.get_token_value(lexer.tokens[failure_pos])) + ">>.";
+    } else if (lexer.get_pos() < source_text.length()) {
+        // The tokens ran out at a symbol the lexer doesn't know
+        offset = lexer.get_pos();
+        const std::size_t symbol_length = std::max<std::size_t>(1,
+            utf8::sequence_length(static_cast<unsigned char>(source_text[offset])));
+        message = "unknown symbol <<" + std::string(source_text.substr(offset, symbol_length)) + ">>.";
+    }
+
+    SourceLocation location = lexer.get_location(static_cast<uint32_t>(offset));
+    std::cerr << source_path.string() << ":" << location.line << ":" << location.column << ": " << message << std::endl;
+}
+
+// Token files keep no lines, the token is named by its index instead
+void print_tokens_syntax_error(const std::filesystem::path &tokens_path, const Lexer &lexer, const uint32_t failure_pos) {
+    if (failure_pos < lexer.tokens.size())
+        std::cerr << tokens_path.string() << ": token #" << failure_pos << " <<"
+            << lexer.get_token_value(lexer.tokens[failure_pos]) << ">>: syntax error." << std::endl;
+    else
+        std::cerr << tokens_path.string() << ": syntax error, the tokens end too early." << std::endl;
 }
 
 int main(int args_num, char **args) {
+    // Options may go anywhere after the command
+    bool json_output = false;
+    unsigned int threads_num = 1;
+    bool threads_num_given = false;
+    bool use_cache = true;
+    std::filesystem::path output_dir{};
+    std::vector<char *> positional{};
+    for (int i = 0; i < args_num; i++) {
+        if (std::strcmp(args[i], "--json") == 0)
+            json_output = true;
+        else if (std::strcmp(args[i], "--no-cache") == 0)
+            use_cache = false;
+        else if (std::strcmp(args[i], "-j") == 0 && i + 1 < args_num) {
+            threads_num = std::max(1, std::atoi(args[++i]));
+            threads_num_given = true;
+        } else if (std::strcmp(args[i], "-o") == 0 && i + 1 < args_num)
+            output_dir = args[++i];
+        else
+            positional.push_back(args[i]);
+    }
+    args_num = static_cast<int>(positional.size());
+    args = positional.data();
+
+    // Owned by the compilation session, every stage refers to identifiers by its ids.
+    // Tokens, symbols and the syntax tree are allocated from the arena and freed with it in one go
+    Arena arena{};
+    Interner interner{&arena};
+    Ast ast{&arena};
+
+    TokenCache cache{};
+    const TokenCache *tokens_cache = use_cache ? &cache : nullptr;
+
     if (args_num >= 3) {
         if (std::strcmp(args[1], "t") == 0) {
 
-            std::cout << "Tokenizing <<" << args[2] << ">>..." << std::endl;
+            // Lexing stdin chunk by chunk, only the json output is written as tokens come
+            if (std::strcmp(args[2], "-") == 0) {
+                std::cout << "Tokenizing <<" << args[2] << ">>..." << std::endl;
 
-            // Opening & reading source file
-            std::filesystem::path file_path = args[2];
+                std::filesystem::path destination_path = args_num >= 4 ? args[3] : default_tokens_path(json_output);
+                StreamingLexer stream{STDIN_FILENO};
 
-            if (!std::filesystem::exists(file_path)) {
-                std::cout << "File <<" << file_path << ">> doesn't exist!" << std::endl;
-                return -1;
+                if (json_output) {
+                    std::ofstream out_file{destination_path};
+                    TokenJsonWriter writer{out_file};
+                    for (const StreamingLexer::StreamToken &token : stream)
+                        writer.push(Token(token.type), token.value);
+                    writer.finish();
+                } else {
+                    Lexer lexer{interner, "", &arena};
+                    for (const StreamingLexer::StreamToken &token : stream)
+                        lexer.push_pooled_token(token.type, token.value);
+
+                    std::ofstream out_file{destination_path, std::ios::binary};
+                    lexer.serialize_to_binary(out_file);
+                }
+
+                if (stream.get_read_error() != 0) {
+                    std::cerr << "Could not read the input: " << std::strerror(stream.get_read_error()) << std::endl;
+                    return -1;
+                }
+                if (std::optional<uint64_t> invalid_offset = stream.get_invalid_utf8_offset()) {
+                    const SourceLocation location = stream.get_invalid_utf8_location();
+                    std::cerr << "stdin:" << location.line << ":" << location.column << ": not valid UTF-8 at byte "
+                        << invalid_offset.value() << ", tokens after it are dropped." << std::endl;
+                    return -1;
+                }
+                if (stream.is_too_long()) {
+                    std::cerr << "The input is longer than 4 GiB, tokens after it are dropped." << std::endl;
+                    return -1;
+                }
+                if (stream.stopped_early()) {
+                    const SourceLocation location = stream.get_stop_location();
+                    std::cerr << "stdin:" << location.line << ":" << location.column << ": unknown symbol <<"
+                        << stream.get_stop_symbol() << ">>, tokens after it are dropped." << std::endl;
+                    return -1;
+                }
+                return 0;
             }
 
-            std::ifstream file {file_path};
-            std::string source_text;
-            source_text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            // mozart t <source_file> [destination_file] keeps its meaning, anything else is a batch
+            const bool single_file = args_num == 3 || (args_num == 4 && args[3][0] != '@' && !is_source_path(args[3]));
+            if (single_file && args[2][0] != '@' && output_dir.empty()) {
+                std::cout << "Tokenizing <<" << args[2] << ">>..." << std::endl;
 
-            // Tokenizing its content
-            Lexer lexer(source_text);
-            lexer.tokenize();
+                std::filesystem::path destination_path = args_num == 4 ? args[3] : default_tokens_path(json_output);
+                TokenizeReport report = tokenize_file(args[2], destination_path, json_output, threads_num, tokens_cache);
+                std::cerr << report.messages;
+                if (use_cache)
+                    cache.trim();
+                return report.failed || report.stopped_early ? -1 : 0;
+            }
+
+            std::vector<std::filesystem::path> source_paths{};
+            for (int i = 2; i < args_num; i++) {
+                if (args[i][0] != '@') {
+                    source_paths.push_back(args[i]);
+                    continue;
+                }
+
+                std::optional<std::vector<std::filesystem::path>> listed = read_response_file(args[i] + 1);
+                if (!listed.has_value()) {
+                    std::cerr << "Response file <<" << args[i] + 1 << ">> can't be read!" << std::endl;
+                    return -1;
+                }
+                source_paths.insert(source_paths.end(), listed.value().begin(), listed.value().end());
+            }
+
+            // Made once for the whole batch, a failure is not reported for every file
+            if (!output_dir.empty()) {
+                std::error_code error;
+                std::filesystem::create_directories(output_dir, error);
+                if (error) {
+                    std::cerr << "Directory <<" << output_dir.string() << ">> can't be created: " << error.message()
+                        << std::endl;
+                    return -1;
+                }
+            }
+
+            // Without -j every core takes files, each file is lexed on a single thread
+            unsigned int workers_num = threads_num_given ? threads_num : std::thread::hardware_concurrency();
+            std::cout << "Tokenizing " << source_paths.size() << " files on " << std::max(1u, workers_num)
+                << " threads..." << std::endl;
+
+            std::vector<TokenizeReport> reports(source_paths.size());
+            const auto batch_start = std::chrono::steady_clock::now();
+            {
+                ThreadPool pool{workers_num};
+                for (std::size_t i = 0; i < source_paths.size(); i++) {
+                    pool.submit([&, i] {
+                        reports[i] = tokenize_file(source_paths[i],
+                            batch_tokens_path(source_paths[i], output_dir, json_output), json_output, 1, tokens_cache);
+                    });
+                }
+                pool.wait();
+            }
+            const std::chrono::duration<double> batch_time = std::chrono::steady_clock::now() - batch_start;
+
+            if (use_cache)
+                cache.trim();
 
-            // Opening output file
-            std::ofstream out_file{"mozart.tokens.json"};
-            out_file << lexer.serialize_to_json();
-            out_file.close();
+            return print_batch_summary(reports, batch_time.count()) ? 0 : -1;
 
         } else if (std::strcmp(args[1], "p") == 0) {
 
@@ -54,17 +437,75 @@ int main(int args_num, char **args) {
                 return -1;
             }
 
-            std::ifstream file {file_path};
-            std::string file_text;
+            std::optional<SourceFile> tokens_file = SourceFile::open(file_path);
+            if (!tokens_file.has_value()) {
+                std::cerr << "File <<" << file_path << ">> can't be read!" << std::endl;
+                return -1;
+            }
+
+            Lexer lexer{interner, "", &arena};
+            std::string_view tokens_data = tokens_file.value().get_text();
+            if (token_file::has_magic(tokens_data))
+                lexer.load_from_binary(tokens_data);
+            else
+                lexer.load_from_json_str(tokens_data);
+
+            Parser parser{lexer.tokens, lexer.get_source_text(), ast};
+            if (!parser.parse_program().has_value()) {
+                print_tokens_syntax_error(file_path, lexer, parser.get_failure_pos());
+                return -1;
+            }
+
+        } else if (std::strcmp(args[1], "c") == 0) {
+
+            std::cout << "Compiling <<" << args[2] << ">>..." << std::endl;
+
+            std::filesystem::path file_path = args[2];
+
+            std::optional<SourceFile> source = SourceFile::open(file_path);
+            if (!source.has_value()) {
+                std::cerr << "File <<" << file_path << ">> can't be read!" << std::endl;
+                return -1;
+            }
+            if (source.value().get_text().length() > Token::MAX_SOURCE_SIZE) {
+                std::cerr << "File <<" << file_path << ">> is larger than 4 GiB, it can't be compiled!" << std::endl;
+                return -1;
+            }
+
+            Lexer lexer(interner, source.value().get_text(), &arena);
+            if (std::optional<std::size_t> invalid_offset = lexer.get_invalid_utf8_offset()) {
+                SourceLocation location = lexer.get_location(invalid_offset.value());
+                std::cerr << file_path.string() << ":" << location.line << ":" << location.column
+                    << ": not valid UTF-8." << std::endl;
+                return -1;
+            }
 
-            file_text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            // Cached tokens are parsed in place of lexing the source again. They know no lines,
+            // a source they don't parse from is lexed to tell where it fails
+            std::optional<SourceFile> cached = use_cache ? cache.lookup(source.value().get_text()) : std::nullopt;
+            if (cached.has_value()) {
+                Lexer cached_lexer{interner, "", &arena};
+                cached_lexer.load_from_binary(cached.value().get_text());
 
-            Lexer lexer{};
-            lexer.load_from_json_str(file_text);
+                Parser parser{cached_lexer.tokens, cached_lexer.get_source_text(), ast};
+                if (parser.parse_program().has_value())
+                    return 0;
+                ast.clear();
+            }
+
+            // The parser pulls every token out of the lexer as it gets to it
+            Generator<Token> token_feed = lexer.tokenize_lazily();
 
-            Parser parser{lexer.tokens};
-            parser.parse_program();
-            assert(true);
+            Parser parser{lexer.tokens, lexer.get_source_text(), ast, &token_feed};
+            if (!parser.parse_program().has_value()) {
+                print_syntax_error(file_path, lexer, parser.get_failure_pos());
+                return -1;
+            }
+            // The tokens before an unknown symbol may make a program of their own
+            if (lexer.get_pos() < lexer.get_source_text().length()) {
+                print_syntax_error(file_path, lexer, static_cast<uint32_t>(lexer.tokens.size()));
+                return -1;
+            }
 
         } else {
             print_usage();
@@ -72,4 +513,4 @@ int main(int args_num, char **args) {
     } else {
         print_usage();
     }
-}
\ No newline at end of file
+}
\ No newline at end of file